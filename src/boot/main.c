@@ -1,9 +1,19 @@
 #include "defs.h"
 #include "riscv.h"
 #include "types.h"
+#include "param.h"
+#include "percpu.h"
+#include "static_key.h"
+#include "trace.h"
+
+#if defined(TRACE) && !defined(TRACE_MASK)
+#define TRACE_MASK ((1 << NTRACE) - 1) // -DTRACE 默认打开全部 tracepoint
+#endif
 
 volatile static int started = 0;
 
+extern pagetable_t kernel_pagetable; // vm.c
+
 void main()
 {
     // uart_puts("\nhere!\n");
@@ -15,6 +25,17 @@ void main()
 
         printfinit(); // 初始化printf功能
 
+        if (PERCPU_NCPU != NCPU)
+            panic("kernel.ld: per-CPU copies != NCPU");
+
+        rcuinit();          // 其他 CPU 启动前先视为空闲
+        rcu_cpu_online();
+        ipi_online();
+        static_key_init();
+        #ifdef PAGE_TABLE_DEBUG
+        static_key_enable(&walk_debug); // 跟踪 TRAMPOLINE 的页表遍历
+        #endif
+
         kinit(); // 物理页面分配器初始化
 
         uart_puts("\nxv6 is booting!\n");
@@ -22,6 +43,30 @@ void main()
         plicinithart();       // 每个核都要去向 PLIC 请求设备
         kvminit();          // 创建内核页表
         kvminithart();      // 开启分页机制
+        trapinit();         // 时钟计数的 seqlock
+        trapinithart();     // 设置中断向量表, 缺页换入需要经过 kerneltrap
+        timerinithart();    // 由本 CPU 的定时事件决定下一次时钟中断
+        virtio_disk_init(); // 交换区所在的 virtio 磁盘
+        swapinit();         // 页面回收与交换
+        textcache_init();   // 共享代码页缓存
+        futexinit();        // 用户态 futex 的等待队列
+        #ifdef PAGEOPS_BENCH
+        pageops_bench();    // 标量与向量页操作的吞吐量对比
+        #endif
+        #ifdef PAGE_TABLE_DEBUG
+        ptstat_print("kernel", kernel_pagetable); // 内核页表的占用与映射统计
+        #endif
+        #ifdef LOCKSTAT
+        lockstat_print();   // 启动过程中各把锁的竞争统计
+        #endif
+        #ifndef DEBUG_CHECKS
+        static_key_disable(&debug_checks); // 去掉锁和分配器热路径上的调试检查
+        #endif
+        #ifdef TRACE
+        trace_print_layout();
+        trace_enable_mask(TRACE_MASK); // 启动后打开的 tracepoint
+        #endif
+        klog_init();        // 此后 printf 写入日志环，由空闲循环输出
         __sync_synchronize(); // 确保代码不乱序执行
         started = 1;
 
@@ -38,22 +83,34 @@ void main()
 
 
 
+        fence_i(); // hart 0 可能已经改写了 static key 使用点
+        rcu_cpu_online();
+        ipi_online();
         printf("\nhart %d starting!\n", cpuid());
         kvminithart();
+        trapinithart();
+        timerinithart();
         plicinithart();
 
         __sync_synchronize();
     }
 
-    // 设置中断向量表
-    // trapinithart();
-
-    // 启用 S 模式下的中断
-    // intr_on();
+    // 启用 S 模式下的中断：uart 发送、virtio 和时钟节拍
+    intr_on();
 
     while (1)
     {
-        // 在此循环中可以处理中断
+        consolepoll();       // 执行控制台输入的内核命令（!help）
+        // 关中断等待：有中断待处理时 wfi 仍会返回，
+        // 但中断处理程序要到 pop_off() 之后才运行，那时本 CPU 已离开 RCU 空闲状态
+        push_off();
+        klog_drain();        // 输出各 CPU 日志环中的新记录
+        rcu_poll();          // 执行宽限期已过的 RCU 回调
+        rcu_idle_enter();
+        tick_stop();         // 空闲时不需要周期节拍，只被设备中断和 IPI 唤醒
         asm volatile("wfi"); // 等待中断（Wait For Interrupt）
+        tick_restart();
+        rcu_idle_exit();
+        pop_off();
     }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "memlayout.h"
+#include "percpu.h"
 
 // 启动阶段的全局变量
 // entry.S需要为每个CPU分配一个栈空间
@@ -10,24 +11,39 @@
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // 每个CPU的机器模式定时器中断的临时存储区域
-// 每个CPU需要5个64位字的空间来保存中断处理时的上下文
-uint64 timer_scratch[NCPU][5];
+// 每个CPU需要6个64位字的空间来保存中断处理时的上下文
+// 放在 per-CPU 区域，各 CPU 的 scratch 不在同一缓存行
+DEFINE_PER_CPU(uint64, timer_scratch[6]);
+
+// 启动时在机器模式下探测到的处理器扩展（CPUF_* 位）
+uint64 cpufeatures;
+
+// cbo.zero 探测时清零的缓存块
+__attribute__ ((aligned (CBOZ_BLOCK_SIZE))) static char cboz_probe[CBOZ_BLOCK_SIZE];
 
 // 外部声明
 extern void timervec();
+extern void probevec();
 void main();
 
 // 内部函数声明
 static void setup_supervisor_mode(void);
 static void setup_memory_protection(void);
 static void setup_interrupt_delegation(void);
-static void timer_init(void);
+static void timer_init(uint64 features);
 static void setup_timer_scratch(int cpu_id, int timer_interval);
+static uint64 detect_cpu_features(void);
+static uint64 setup_extensions(void);
 
 // entry.S在机器模式下跳转到此处，完成从M模式到S模式的转换
 void
 start()
 {
+  // 探测可选扩展并在本核上打开（探测会临时改写 mtvec，需在 timer_init 之前）
+  // 必须最先做：探测指令陷入 probevec 时，trap 和 mret 会改写 mepc 和 mstatus.MPP，
+  // 之后 setup_supervisor_mode() 才能设定最终 mret 的目标
+  uint64 features = setup_extensions();
+
   // 设置管理者模式(Supervisor Mode)相关配置
   setup_supervisor_mode();
   
@@ -36,9 +52,12 @@ start()
   
   // 配置物理内存保护
   setup_memory_protection();
-  
+
   // 初始化定时器中断
-  timer_init();
+  timer_init(features);
+
+  // 允许 S 模式通过 rdtime 读取 mtime
+  w_mcounteren(r_mcounteren() | MCOUNTEREN_TM);
   
   // 保存当前CPU ID到tp寄存器
   w_tp(r_mhartid());
@@ -100,15 +119,25 @@ setup_memory_protection(void)
 // 初始化定时器中断
 // 定时器中断的处理策略：M模式定时器中断触发S模式软件中断
 // 这样可以避免在内核关键操作中被定时器中断直接打断
+//
+// 支持 Sstc 时 S 模式直接使用 stimecmp，时钟中断就是 S 模式的时钟中断，
+// 不再经过 timervec；机器模式只剩 IPI 用的软件中断。
 static void 
-timer_init(void)
+timer_init(uint64 features)
 {
   int cpu_id = r_mhartid();
-  int timer_interval = 1000000;  // 定时器间隔(CPU周期数)
+  int timer_interval = TICK_INTERVAL;  // 定时器间隔(CPU周期数)
+  // 用探测结果而不是读 menvcfg：没有 menvcfg 的核上读它会陷入
+  int sstc = (features & CPUF_SSTC) != 0;
   
   // 设置下一次定时器中断的时间
   // 每个CPU核有独立的mtimecmp寄存器
-  *(uint64*)CLINT_MTIMECMP(cpu_id) = *(uint64*)CLINT_MTIME + timer_interval;
+  if(sstc){
+    *(uint64*)CLINT_MTIMECMP(cpu_id) = -1;  // 机器模式时钟不再使用
+    w_stimecmp(*(uint64*)CLINT_MTIME + timer_interval);
+  } else {
+    *(uint64*)CLINT_MTIMECMP(cpu_id) = *(uint64*)CLINT_MTIME + timer_interval;
+  }
   
   // 为timervec准备scratch内存区域
   setup_timer_scratch(cpu_id, timer_interval);
@@ -119,8 +148,8 @@ timer_init(void)
   // 启用机器模式中断
   w_mstatus(r_mstatus() | MSTATUS_MIE);
   
-  // 启用机器模式定时器中断
-  w_mie(r_mie() | MIE_MTIE);
+  // 启用其他 CPU 发来 IPI 用的机器模式软件中断，没有 Sstc 时还有机器模式定时器中断
+  w_mie(r_mie() | (sstc ? 0 : MIE_MTIE) | MIE_MSIE);
 }
 
 // 设置定时器中断的scratch内存区域
@@ -131,12 +160,69 @@ setup_timer_scratch(int cpu_id, int timer_interval)
   // scratch数组布局：
   // [0-2]: 保存寄存器的空间
   // [3]:   CLINT MTIMECMP寄存器地址
-  // [4]:   定时器中断间隔
+  // [4]:   定时器中断间隔（时钟改为一次性后 timervec 不再使用）
+  // [5]:   时钟中断待处理标志（见 trap.c 的 softintr()）
   
-  uint64 *scratch = &timer_scratch[cpu_id][0];
+  uint64 *scratch = per_cpu(timer_scratch, cpu_id);
   scratch[3] = CLINT_MTIMECMP(cpu_id);  // 定时器比较寄存器地址
   scratch[4] = timer_interval;          // 中断间隔
   
   // 将scratch数组地址存储到mscratch寄存器
   w_mscratch((uint64)scratch);
-}
\ No newline at end of file
+}
+
+// 试执行一条可能不被支持的指令。不支持时陷入 probevec，
+// 它跳过这条（4 字节的）指令并把 a0 清零。返回 1 表示指令正常执行。
+// 调用前 mtvec 必须指向 probevec。
+#define PROBE_INSN(insn, ...) ({                                  \
+  uint64 ok;                                                      \
+  asm volatile("li a0, 1\n\t" insn "\n\tmv %0, a0"               \
+               : "=r" (ok) : __VA_ARGS__ : "a0", "t0", "memory");  \
+  ok;                                                             \
+})
+
+// 探测处理器支持的可选扩展，返回 CPUF_* 位
+// 单字母扩展从 misa 读出；其余扩展没有设备树可查，靠试执行判断
+static uint64
+detect_cpu_features(void)
+{
+  uint64 features = 0;
+
+  if(r_misa() & MISA_EXT('V'))
+    features |= CPUF_V;
+
+  w_mtvec((uint64)probevec);
+
+  // Zicboz 需要 menvcfg 才能下放给 S 模式；机器模式下 cbo.zero 总是允许的
+  if(PROBE_INSN("csrr t0, 0x30a") &&
+     PROBE_INSN(".insn i 0x0f, 2, x0, %1, 4", "r" (cboz_probe)))
+    features |= CPUF_ZICBOZ;
+
+  // Sstc 同样靠 menvcfg.STCE 下放；机器模式总能访问 stimecmp
+  if(PROBE_INSN("csrr t0, 0x30a") && PROBE_INSN("csrr t0, 0x14d"))
+    features |= CPUF_SSTC;
+
+  return features;
+}
+
+// 探测可选扩展并在本核上打开
+// 每个核都要设置自己的 menvcfg；cpufeatures 由 hart 0 公布，
+// 其他核在 main() 中等到 started 之后才会读它。返回本核的 CPUF_* 位
+static uint64
+setup_extensions(void)
+{
+  uint64 features = detect_cpu_features();
+
+  if(r_mhartid() == 0)
+    cpufeatures = features;
+
+  // 允许 S 模式执行 cbo.zero；senvcfg.CBZE（U 模式）保持关闭
+  if(features & CPUF_ZICBOZ)
+    w_menvcfg(r_menvcfg() | ENVCFG_CBZE);
+
+  // 让 S 模式使用 stimecmp（需要 mcounteren.TM，在 start() 中打开）
+  if(features & CPUF_SSTC)
+    w_menvcfg(r_menvcfg() | ENVCFG_STCE);
+
+  return features;
+}
@@ -1,7 +1,17 @@
+#include <stdarg.h>
+
 #include "types.h"
 #include "spinlock.h"
 #include "riscv.h"
 
+struct swapstat;
+struct rwlock;
+struct rcu_head;
+struct sleeplock;
+struct waitq;
+struct hrtimer;
+struct ptstat;
+
 #define RHR 0                 // receive holding register (for input bytes)
 #define THR 0  
 #define LSR 5
@@ -10,7 +20,18 @@
 void            uart_putc(uint8 c);
 void            uart_puts(char *s);
 void            uartinit(void);
+void            uartintr(void);
+int             uartgetc(void);
+void            uartputc(uint8 c);
+void            uartputs(char *s, int n);
 void            uartputc_sync(uint8 c);
+void            uartputs_sync(char *s, int n);
+
+// start.c
+extern uint64   cpufeatures;    // 启动时探测到的可选扩展
+#define CPUF_V          (1 << 0) // RVV 向量扩展
+#define CPUF_ZICBOZ     (1 << 1) // Zicboz 缓存块清零
+#define CPUF_SSTC       (1 << 2) // Sstc: S 模式时钟比较寄存器 stimecmp
 
 // plic.c
 void            plicinit(void);
@@ -19,7 +40,41 @@ int             plic_claim(void);
 void            plic_complete(int);
 
 // 设置异常向量表
+void trapinit(void);
 void trapinithart(void);
+uint readticks(void);
+int softintr(void);
+
+// timer.c
+void            timerinithart(void);
+void            timer_reprogram(void);
+int             timer_expire(void);
+void            tick_stop(void);
+void            tick_restart(void);
+
+// hrtimer.c
+uint64          ktime_get_ns(void);
+uint64          ns_to_mtime(uint64);
+void            hrtimerinithart(void);
+void            hrtimer_init(struct hrtimer*, void (*)(struct hrtimer*));
+void            hrtimer_start(struct hrtimer*, uint64);
+void            hrtimer_start_ns(struct hrtimer*, uint64);
+int             hrtimer_cancel(struct hrtimer*);
+int             hrtimer_try_cancel(struct hrtimer*);
+uint64          hrtimer_next(void);
+void            hrtimer_run(uint64);
+void            hrtimer_sleep_ns(uint64);
+
+// ipi.c
+#define IPI_WAKE        (1 << 0) // 唤醒在 waitq 中等待的 CPU
+#define IPI_FENCE_I     (1 << 1) // 内核代码被改写，执行 fence.i
+#define IPI_SFENCE      (1 << 2) // 页表项被改写，执行 sfence.vma 并确认
+void            ipi_online(void);
+void            ipi_send(int, uint);
+void            ipi_send_others(uint);
+uint            ipi_take(void);
+void            ipi_sfence(void);
+void            sfence_vma_all(void);
 
 // proc.c
 int cpuid();
@@ -29,18 +84,83 @@ struct cpu* mycpu(void);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlock_kind(struct spinlock*, char*, int);
+#ifdef LOCKSTAT
+void            lockstat_print(void);
+void            lockstat_reset(void);
+#endif
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// rcu.c
+void            rcuinit(void);
+void            rcu_cpu_online(void);
+void            rcu_quiescent(void);
+void            rcu_idle_enter(void);
+void            rcu_idle_exit(void);
+void            rcu_poll(void);
+int             rcu_pending(void);
+void            synchronize_rcu(void);
+void            call_rcu(struct rcu_head*, void (*)(struct rcu_head*));
+void            kfree_rcu(struct rcu_head*);
+
+// sleeplock.c
+void            acquiresleep(struct sleeplock*);
+void            releasesleep(struct sleeplock*);
+int             holdingsleep(struct sleeplock*);
+void            initsleeplock(struct sleeplock*, char*);
+
+// waitq.c
+void            initwaitq(struct waitq*, char*);
+void            waitq_sleep(struct waitq*, struct spinlock*);
+void            waitq_wakeup(struct waitq*);
+
+// futex.c
+void            futexinit(void);
+int             futex_wait(pagetable_t, uint64, uint);
+int             futex_wake(pagetable_t, uint64, int);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            read_lock(struct rwlock*);
+void            read_unlock(struct rwlock*);
+void            write_lock(struct rwlock*);
+void            write_unlock(struct rwlock*);
+
 // printf.c
 void            printf(char*, ...);
+int             snprintf(char*, int, char*, ...);
+int             vsnprintf(char*, int, char*, va_list);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// klog.c
+extern int      klog_on;
+void            klog_init(void);
+void            klog_write(uint64, char*, int, int);
+void            klog_drain(void);
+void            klog_dump(void);
+
+// trace.c
+int             trace_enable(char*);
+int             trace_disable(char*);
+void            trace_enable_mask(uint);
+int             trace_active(void);
+void            trace_reset(void);
+void            trace_dump(void);
+void            trace_print_layout(void);
+
 // console.c
 void consputc(int c);
+void consputs(char *s, int n);
 void consoleinit(void);
+void consoleintr(char *s, int n);
+void consolepoll(void);
+
+// kcmd.c
+void            kcmd_run(char*);
+int consoleread(char *dst, int n);
 
 // vm.c
 void            kvminit(void);
@@ -61,6 +181,14 @@ int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 
+// static_key.c
+struct static_key;
+void            static_key_init(void);
+void            static_key_enable(struct static_key*);
+void            static_key_disable(struct static_key*);
+struct static_key* static_key_lookup(char*);
+void            static_key_print(void);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -70,8 +198,49 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// pageops.c
+void            blk_zero(void *, uint64);
+void            blk_copy(void *, const void *, uint64);
+int             blk_cmp(const void *, const void *, uint64);
+void            page_zero(void *);
+void            page_copy(void *, const void *);
+int             page_cmp(const void *, const void *);
+void            pageops_bench(void);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
 
+// swap.c
+void            swapinit(void);
+int             swap_register(pagetable_t, uint64);
+void            swap_unregister(pagetable_t);
+void            swap_lock(void);
+void            swap_unlock(void);
+void            swap_discard(pte_t *);
+int             reclaim(int);
+int             swap_fault(pagetable_t, uint64, int);
+int             swap_pin(pagetable_t, uint64, uint64 *);
+void            swap_unpin(uint64);
+void            swapstat(struct swapstat *);
+void            swapstat_print(void);
+
+// ptstat.c
+void            ptstat_collect(pagetable_t, struct ptstat *);
+void            ptstat_print(char *, pagetable_t);
+
+// textcache.c
+void            textcache_init(void);
+uint64          textpage_get(uint, uint, uint64);
+uint64          textpage_add(uint, uint, uint64, uint64);
+void            textpage_put(uint64);
+void            textcache_invalidate(uint, uint);
+int             textmap(pagetable_t, uint64, uint, uint, uint64, int, int (*)(void *, char *, uint64), void *);
+
+// virtio_disk.c
+void            virtio_disk_init(void);
+uint64          virtio_disk_size(void);
+int             virtio_disk_rw(uint64, void *, int);
+void            virtio_disk_intr(void);
+
@@ -1,16 +1,38 @@
+//
+// Console input and output, to the uart.
+// Reads are line at a time.
+// Implements special input characters:
+//   newline -- end of line
+//   control-h -- backspace
+//   control-u -- kill line
+//   control-d -- end of file
+//   '!' at the start of a line -- 内核命令，见 lib/kcmd.c
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
 #include "defs.h"
+#include "waitq.h"
+
+extern volatile int panicking; // from printf.c
 
 #define BACKSPACE 0x100
+#define C(x)  ((x)-'@')  // Control-x
+#define KCMD_SIZE 64
 
 struct {
   struct spinlock lock;
-  
-//   // input
-// #define INPUT_BUF_SIZE 128
-//   char buf[INPUT_BUF_SIZE];
-//   uint r;  // Read index
-//   uint w;  // Write index
-//   uint e;  // Edit index
+  struct waitq wq;   // 等待输入的读者
+
+  // input
+  char buf[INPUT_BUF_SIZE];
+  uint r;  // Read index
+  uint w;  // Write index
+  uint e;  // Edit index
+
+  char cmd[KCMD_SIZE]; // 等待 consolepoll() 执行的内核命令
+  int cmdready;
 } cons;
 
 
@@ -24,20 +46,196 @@ consputc(int c)
 {
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    uartputc('\b'); uartputc(' '); uartputc('\b');
   } else {
-    uartputc_sync(c);
+    uartputc(c);
   }
 }
 
+// 把 n 个字符一次性送到 uart，只获取一次 uart 锁
+// printf() 用它输出整条格式化好的消息。panic 时改用同步输出
+void
+consputs(char *s, int n)
+{
+  if(panicking)
+    uartputs_sync(s, n);
+  else
+    uartputs(s, n);
+}
+
+//
+// copy (up to) a whole input line to dst.
+// 没有输入时等待，遇到换行、^D 或读满 n 个字节返回。
+// 返回读到的字节数。
+//
+int
+consoleread(char *dst, int n)
+{
+  uint target;
+  int c;
+
+  target = n;
+  acquire(&cons.lock);
+  while(n > 0){
+    // wait until interrupt handler has put some
+    // input into cons.buffer.
+    while(cons.r == cons.w)
+      waitq_sleep(&cons.wq, &cons.lock);
+
+    c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
+
+    if(c == C('D')){  // end-of-file
+      if(n < target){
+        // Save ^D for next time, to make sure
+        // caller gets a 0-byte result.
+        cons.r--;
+      }
+      break;
+    }
+
+    *dst++ = c;
+    --n;
+
+    if(c == '\n'){
+      // a whole line has arrived, return to
+      // the user-level read().
+      break;
+    }
+  }
+  release(&cons.lock);
+
+  return target - n;
+}
+
+// 把一个回显字符追加到 echo 中，BACKSPACE 展开为三个字符
+static int
+echo(char *buf, int n, int c)
+{
+  if(c == BACKSPACE){
+    buf[n++] = '\b'; buf[n++] = ' '; buf[n++] = '\b';
+  } else {
+    buf[n++] = c;
+  }
+  return n;
+}
+
+// 一行以 '!' 开头时，把它作为内核命令取走，不交给 consoleread()。
+// 上一条命令还没执行时丢弃这一条。调用者持有 cons.lock
+static void
+kcmd_take(void)
+{
+  uint n = 0;
+
+  if(cons.buf[cons.w % INPUT_BUF_SIZE] != '!')
+    return;
+  if(!cons.cmdready){
+    for(uint i = cons.w + 1; i < cons.e - 1 && n < KCMD_SIZE - 1; i++)
+      cons.cmd[n++] = cons.buf[i % INPUT_BUF_SIZE];
+    cons.cmd[n] = 0;
+    cons.cmdready = 1;
+  }
+  cons.e = cons.w;
+}
+
+// 由空闲循环调用，执行控制台输入的内核命令
+void
+consolepoll(void)
+{
+  char cmd[KCMD_SIZE];
+
+  if(!cons.cmdready)
+    return;
+  acquire(&cons.lock);
+  memmove(cmd, cons.cmd, KCMD_SIZE);
+  cons.cmdready = 0;
+  release(&cons.lock);
+
+  kcmd_run(cmd);
+}
+
+//
+// the console input interrupt handler.
+// uartintr() calls this for a batch of input characters.
+// do erase/kill processing, append to cons.buf,
+// wake up consoleread() if a whole line has arrived.
+// 整批字符只获取一次 cons.lock，回显也攒成一次输出。
+//
+void
+consoleintr(char *s, int n)
+{
+  char out[3 * 16];
+  int nout = 0, wake = 0;
+
+  acquire(&cons.lock);
+
+  for(int i = 0; i < n; i++){
+    int c = s[i];
+
+    switch(c){
+    case C('U'):  // Kill line.
+      while(cons.e != cons.w &&
+            cons.buf[(cons.e-1) % INPUT_BUF_SIZE] != '\n'){
+        cons.e--;
+        nout = echo(out, nout, BACKSPACE);
+        if(nout > sizeof(out) - 3){
+          consputs(out, nout);
+          nout = 0;
+        }
+      }
+      break;
+    case C('H'): // Backspace
+    case '\x7f': // Delete key
+      if(cons.e != cons.w){
+        cons.e--;
+        nout = echo(out, nout, BACKSPACE);
+      }
+      break;
+    default:
+      if(c != 0 && cons.e-cons.r < INPUT_BUF_SIZE){
+        c = (c == '\r') ? '\n' : c;
+
+        // echo back to the user.
+        nout = echo(out, nout, c);
+
+        // store for consumption by consoleread().
+        cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+
+        if(c == '\n')
+          kcmd_take();
+        if(cons.e != cons.w &&
+           (c == '\n' || c == C('D') || cons.e-cons.r == INPUT_BUF_SIZE)){
+          // a whole line (or end-of-file) has arrived.
+          cons.w = cons.e;
+          wake = 1;
+        }
+      }
+      break;
+    }
+
+    if(nout > sizeof(out) - 3){
+      consputs(out, nout);
+      nout = 0;
+    }
+  }
+
+  // 一批处理完再唤醒，读者醒来时能看到这一批中的所有整行
+  if(wake)
+    waitq_wakeup(&cons.wq);
+
+  if(nout > 0)
+    consputs(out, nout);
+
+  release(&cons.lock);
+}
+
 void
 consoleinit(void)
 {
   initlock(&cons.lock, "cons");
+  initwaitq(&cons.wq, "cons");
 
   uartinit();
 
   // devsw[CONSOLE].read = consoleread;
   // devsw[CONSOLE].write = consolewrite;
 }
-
@@ -1,32 +1,156 @@
+//
+// low-level driver routines for 16550a UART.
+//
+// 输出经过发送环形缓冲区：写者把字节放进缓冲区后立即返回，
+// THR 空中断 (THRE) 到来时由 uartintr() 一次向 FIFO 填入最多 16 个字节。
+// 只有 panic 使用不经过缓冲区的同步输出。
+//
+// 输入同样由中断驱动：接收 FIFO 达到 UARTRXTRIG 个字节，或 FIFO 中有数据
+// 但一段时间没有新字节到来（超时中断）时，uartintr() 一次取空 FIFO，
+// 整批交给 consoleintr()。
+//
+
 #include "defs.h"
 #include "types.h"
+#include "param.h"
 #include "memlayout.h"
 
+// the UART control registers are memory-mapped
+// at address UART0. this macro returns the
+// address of one of the registers.
+#define Reg(reg) ((volatile unsigned char *)(UART0 + (reg)))
+
+// the UART control registers.
+// some have different meanings for
+// read vs write.
+// see http://byterunner.com/16550.html
+// RHR、THR、LSR 和 TX_IDLE 定义在 defs.h 中
+#define IER 1                 // interrupt enable register
+#define IER_RX_ENABLE (1<<0)
+#define IER_TX_ENABLE (1<<1)
+#define FCR 2                 // FIFO control register
+#define FCR_FIFO_ENABLE (1<<0)
+#define FCR_FIFO_CLEAR (3<<1) // clear the content of the two FIFOs
+#define FCR_TRIGGER_1  (0<<6) // 接收 FIFO 中断触发深度
+#define FCR_TRIGGER_4  (1<<6)
+#define FCR_TRIGGER_8  (2<<6)
+#define FCR_TRIGGER_14 (3<<6)
+#define ISR 2                 // interrupt status register
+#define LCR 3                 // line control register
+#define LCR_EIGHT_BITS (3<<0)
+#define LCR_BAUD_LATCH (1<<7) // special mode to set baud rate
+#define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
+#define LSR_RX_OVERRUN (1<<1) // 接收 FIFO 溢出，丢失了字节
+
+#define ReadReg(reg) (*(Reg(reg)))
+#define WriteReg(reg, v) (*(Reg(reg)) = (v))
+
+#define UART_FIFO_SIZE 16     // 16550 的发送 FIFO 深度
+
+#if UARTRXTRIG == 1
+#define FCR_TRIGGER FCR_TRIGGER_1
+#elif UARTRXTRIG == 4
+#define FCR_TRIGGER FCR_TRIGGER_4
+#elif UARTRXTRIG == 8
+#define FCR_TRIGGER FCR_TRIGGER_8
+#elif UARTRXTRIG == 14
+#define FCR_TRIGGER FCR_TRIGGER_14
+#else
+#error "UARTRXTRIG must be 1, 4, 8 or 14"
+#endif
+
 extern volatile int panicked; // from printf.c
 
+// the transmit output buffer.
+struct spinlock uart_tx_lock;
+#define UART_TX_BUF_SIZE 1024
+char uart_tx_buf[UART_TX_BUF_SIZE];
+uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
+uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+
+uint uart_rx_overruns; // 接收 FIFO 溢出次数，非 0 说明中断处理不够及时
 
-struct spinlock uart_tx_lock; 
+static void uartstart(void);
 
 void uart_putc(uint8 c){
     while((*(volatile uint8 *)(UART0 + LSR) & TX_IDLE) == 0);
     *(volatile uint8*)(UART0 + THR) = c;
 }
 
+// 把一个字节放进发送缓冲区。调用者持有 uart_tx_lock。
+// 缓冲区满时在这里轮询 UART，直到腾出空间：
+// 持有 spinlock 时不能等待中断。
+static void
+uart_enqueue(uint8 c)
+{
+  while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+    while((ReadReg(LSR) & TX_IDLE) == 0)
+      ;
+    uartstart();
+  }
+  uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
+  uart_tx_w += 1;
+}
 
-// TODO: 缓冲区机制解决外设速度不匹配
-void uartputc_sync(uint8 c){
+// add a character to the output buffer and tell the
+// UART to start sending if it isn't already.
+// 缓冲区没满时不等待 UART。
+void
+uartputc(uint8 c)
+{
+  acquire(&uart_tx_lock);
 
-    acquire(&uart_tx_lock);
+  // 如果 panicked, 所有核都不在输出任何信息，并死循环
+  if(panicked){
+    for(;;)
+      ;
+  }
 
-    // 如果 panicked, 所有核都不在输出任何信息，并死循环
-    if(panicked){
-       for(;;) ;
-    }
+  uart_enqueue(c);
+  uartstart();
+  release(&uart_tx_lock);
+}
 
-    while((*(volatile uint8 *)(UART0 + LSR) & TX_IDLE) == 0);
-    *(volatile uint8*)(UART0 + THR) = c;
+// 连续输出 n 个字节，整段只获取一次 uart_tx_lock，
+// 输出过程中不会和其他 CPU 的字符交错
+void
+uartputs(char *s, int n)
+{
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+
+  for(int i = 0; i < n; i++)
+    uart_enqueue(s[i]);
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// 不经过中断的同步输出，只给 panic 使用。
+// 不获取 uart_tx_lock（panic 的 CPU 可能正持有它），
+// 先把缓冲区中尚未发出的内容送出，保持输出顺序。
+void
+uartputs_sync(char *s, int n)
+{
+  push_off();
+
+  while(uart_tx_r != uart_tx_w){
+    uart_putc(uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+  for(int i = 0; i < n; i++)
+    uart_putc(s[i]);
+
+  pop_off();
+}
 
-    release(&uart_tx_lock);
+void
+uartputc_sync(uint8 c)
+{
+  uartputs_sync((char *)&c, 1);
 }
 
 void uart_puts(char * s){
@@ -34,12 +158,101 @@ void uart_puts(char * s){
     while (*s != '\0')
     {
         //  字符锁，保证不会掉字符，但不保证句间完整性
-        uartputc_sync(*s);
+        uartputc(*s);
         s++;
     }
 }
 
+// if the UART is idle, and a character is waiting
+// in the transmit buffer, send it.
+// 发送 FIFO 为空时一次填入最多 UART_FIFO_SIZE 个字节，
+// FIFO 再次变空时 UART 产生 THRE 中断，由 uartintr() 继续。
+// caller must hold uart_tx_lock.
+// called from both the top- and bottom-half.
+static void
+uartstart(void)
+{
+  if((ReadReg(LSR) & TX_IDLE) == 0){
+    // the UART transmit holding register is full,
+    // so we cannot give it another byte.
+    // it will interrupt when it's ready for a new byte.
+    return;
+  }
+
+  for(int i = 0; i < UART_FIFO_SIZE && uart_tx_r != uart_tx_w; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+}
+
+// read one input character from the UART.
+// return -1 if none is waiting.
+int
+uartgetc(void)
+{
+  uint8 lsr = ReadReg(LSR);
+
+  if(lsr & LSR_RX_OVERRUN)
+    uart_rx_overruns++;
+  if(lsr & LSR_RX_READY){
+    // input data is ready.
+    return ReadReg(RHR);
+  } else {
+    return -1;
+  }
+}
+
+// handle a uart interrupt, raised because input has
+// arrived, or the uart is ready for more output, or
+// both. called from devintr().
+void
+uartintr(void)
+{
+  char buf[UART_FIFO_SIZE];
+  int c, n;
+
+  // 读 ISR 应答中断
+  ReadReg(ISR);
+
+  // read and process incoming characters.
+  // 取空接收 FIFO，每批最多一个 FIFO 的字节，只获取一次控制台锁
+  do {
+    n = 0;
+    while(n < sizeof(buf) && (c = uartgetc()) != -1)
+      buf[n++] = c;
+    if(n > 0)
+      consoleintr(buf, n);
+  } while(n == sizeof(buf));
+
+  // send buffered characters.
+  acquire(&uart_tx_lock);
+  uartstart();
+  release(&uart_tx_lock);
+}
+
 void uartinit(){
+  // disable interrupts.
+  WriteReg(IER, 0x00);
+
+  // special mode to set baud rate.
+  WriteReg(LCR, LCR_BAUD_LATCH);
+
+  // LSB for baud rate of 38.4K.
+  WriteReg(0, 0x03);
+
+  // MSB for baud rate of 38.4K.
+  WriteReg(1, 0x00);
 
-  initlock(&uart_tx_lock, "uart");
-}
\ No newline at end of file
+  // leave set-baud mode,
+  // and set word length to 8 bits, no parity.
+  WriteReg(LCR, LCR_EIGHT_BITS);
+
+  // reset and enable FIFOs.
+  // 接收 FIFO 攒到 UARTRXTRIG 个字节才中断，不足的部分由超时中断送达
+  WriteReg(FCR, FCR_FIFO_ENABLE | FCR_FIFO_CLEAR | FCR_TRIGGER);
+
+  // enable transmit and receive interrupts.
+  WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+
+  initlock_kind(&uart_tx_lock, "uart", SPIN_TICKET);
+}
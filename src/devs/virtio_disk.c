@@ -0,0 +1,266 @@
+//
+// driver for qemu's virtio disk device.
+// uses qemu's mmio interface to virtio.
+//
+// 提交描述符链后在 waitq 上等待，由 virtio_disk_intr() 发现 used 环前进后唤醒；
+// 调用者持有其他 spinlock（设备中断进不来）时改为轮询 used 环。
+// 磁盘只用作交换区（见 mm/swap.c），每次请求读写一个完整的物理页。
+//
+// qemu ... -drive file=swap.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+#include "waitq.h"
+#include "virtio.h"
+
+// the address of virtio mmio register r.
+#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+
+#define SECTOR_SIZE 512
+
+static struct disk {
+  // a set (not a ring) of DMA descriptors, with which the
+  // driver tells the device where to read and write individual
+  // disk operations. 同一时刻只有一个请求在途，固定使用 0,1,2 号描述符。
+  struct virtq_desc *desc;
+
+  // a ring in which the driver writes descriptor numbers
+  // that the driver would like the device to process.
+  struct virtq_avail *avail;
+
+  // a ring in which the device writes descriptor numbers that
+  // the device has finished processing (just the head of each chain).
+  struct virtq_used *used;
+
+  uint16 used_idx; // we've looked this far in used[2..NUM].
+
+  struct virtio_blk_req req; // 请求头，第一个描述符指向这里
+  volatile uint8 status;     // 设备写回的完成状态，0 表示成功
+
+  uint64 capacity;  // 磁盘容量（扇区数）
+  int present;      // 是否探测到 virtio 块设备
+
+  struct sleeplock vdisk_lock; // 一个请求从提交到完成期间一直持有
+
+  struct spinlock lock; // 保护 used_idx 和 done
+  struct waitq wq;      // 等待请求完成的 CPU
+  int done;             // 在途的请求已完成
+} disk;
+
+// 探测并初始化 virtio 块设备。
+// 与 xv6 不同，找不到磁盘时不 panic，只是让交换区保持关闭。
+void
+virtio_disk_init(void)
+{
+  uint32 status = 0;
+
+  initsleeplock(&disk.vdisk_lock, "virtio_disk");
+  initlock(&disk.lock, "virtio_used");
+  initwaitq(&disk.wq, "virtio_disk");
+
+  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(VIRTIO_MMIO_VERSION) != 2 ||
+     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    printf("virtio disk: not found, swap disabled\n");
+    return;
+  }
+
+  // reset device
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // set ACKNOWLEDGE status bit
+  status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // set DRIVER status bit
+  status |= VIRTIO_CONFIG_S_DRIVER;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // negotiate features
+  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  features &= ~(1 << VIRTIO_BLK_F_RO);
+  features &= ~(1 << VIRTIO_BLK_F_SCSI);
+  features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
+  features &= ~(1 << VIRTIO_BLK_F_MQ);
+  features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
+  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
+  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+
+  // tell device that feature negotiation is complete.
+  status |= VIRTIO_CONFIG_S_FEATURES_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // re-read status to ensure FEATURES_OK is set.
+  status = *R(VIRTIO_MMIO_STATUS);
+  if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
+    panic("virtio disk FEATURES_OK unset");
+
+  // initialize queue 0.
+  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
+
+  // ensure queue 0 is not in use.
+  if(*R(VIRTIO_MMIO_QUEUE_READY))
+    panic("virtio disk should not be ready");
+
+  // check maximum queue size.
+  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtio disk has no queue 0");
+  if(max < NUM)
+    panic("virtio disk max queue too short");
+
+  // allocate and zero queue memory.
+  disk.desc = kalloc();
+  disk.avail = kalloc();
+  disk.used = kalloc();
+  if(!disk.desc || !disk.avail || !disk.used)
+    panic("virtio disk kalloc");
+  page_zero(disk.desc);
+  page_zero(disk.avail);
+  page_zero(disk.used);
+
+  // set queue size.
+  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+
+  // write physical addresses.
+  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
+  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
+  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
+  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
+  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
+  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
+
+  // queue is ready.
+  *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+
+  // tell device we're completely ready.
+  status |= VIRTIO_CONFIG_S_DRIVER_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // 块设备配置空间的前 8 字节是以扇区计的容量
+  disk.capacity = *R(VIRTIO_MMIO_CONFIG) | ((uint64)*R(VIRTIO_MMIO_CONFIG + 4) << 32);
+  disk.present = 1;
+}
+
+// 磁盘容量（字节），没有磁盘时为 0
+uint64
+virtio_disk_size(void)
+{
+  if(!disk.present)
+    return 0;
+  return disk.capacity * SECTOR_SIZE;
+}
+
+// 检查 used 环，在途的请求完成时唤醒等待者。调用者持有 disk.lock
+static void
+vdisk_complete(void)
+{
+  if(*(volatile uint16 *)&disk.used->idx == disk.used_idx)
+    return;
+  __sync_synchronize();
+  disk.used_idx += 1;
+  disk.done = 1;
+  waitq_wakeup(&disk.wq);
+}
+
+// 以页为单位读写磁盘：把 buf 指向的一页写到 / 读自字节偏移 off 处。
+// 等待完成期间本 CPU 停在 waitq 上。成功返回 0，设备报错返回 -1。
+int
+virtio_disk_rw(uint64 off, void *buf, int write)
+{
+  int ret;
+
+  if(!disk.present)
+    panic("virtio_disk_rw: no disk");
+  if(off % SECTOR_SIZE)
+    panic("virtio_disk_rw: unaligned offset");
+
+  acquiresleep(&disk.vdisk_lock);
+
+  // the spec's Section 5.2 says that legacy block operations use
+  // three descriptors: one for type/reserved/sector, one for the
+  // data, one for a 1-byte status result.
+  struct virtio_blk_req *req = &disk.req;
+  req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->reserved = 0;
+  req->sector = off / SECTOR_SIZE;
+
+  disk.desc[0].addr = (uint64) req;
+  disk.desc[0].len = sizeof(struct virtio_blk_req);
+  disk.desc[0].flags = VRING_DESC_F_NEXT;
+  disk.desc[0].next = 1;
+
+  disk.desc[1].addr = (uint64) buf;
+  disk.desc[1].len = PGSIZE;
+  if(write)
+    disk.desc[1].flags = 0; // device reads buf
+  else
+    disk.desc[1].flags = VRING_DESC_F_WRITE; // device writes buf
+  disk.desc[1].flags |= VRING_DESC_F_NEXT;
+  disk.desc[1].next = 2;
+
+  disk.status = 0xff; // device writes 0 on success
+  disk.done = 0;
+  disk.desc[2].addr = (uint64) &disk.status;
+  disk.desc[2].len = 1;
+  disk.desc[2].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[2].next = 0;
+
+  // tell the device the first index in our chain of descriptors.
+  disk.avail->ring[disk.avail->idx % NUM] = 0;
+
+  __sync_synchronize();
+
+  // tell the device another avail ring entry is available.
+  disk.avail->idx += 1; // not % NUM ...
+
+  __sync_synchronize();
+
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+
+  // 等待 virtio_disk_intr() 发现请求完成。
+  // 还持有其他 spinlock 时中断处理不了，只能自己轮询 used 环
+  acquire(&disk.lock);
+  while(!disk.done){
+    if(mycpu()->noff > 1)
+      vdisk_complete();
+    else
+      waitq_sleep(&disk.wq, &disk.lock);
+  }
+  release(&disk.lock);
+
+  ret = disk.status == 0 ? 0 : -1;
+
+  releasesleep(&disk.vdisk_lock);
+  return ret;
+}
+
+void
+virtio_disk_intr(void)
+{
+  if(!disk.present)
+    return;
+
+  acquire(&disk.lock);
+
+  // the device won't raise another interrupt until we tell it
+  // we've seen this interrupt, which the following line does.
+  // this may race with the device writing new entries to
+  // the "used" ring, in which case we may process the new
+  // completion entries in this interrupt, and have nothing to do
+  // in the next interrupt, which is harmless.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  vdisk_complete();
+
+  release(&disk.lock);
+}
@@ -0,0 +1,155 @@
+//
+// 控制台上的内核命令。
+//
+// 在控制台输入以 '!' 开头的一行，consoleintr() 不把它交给读者，
+// 而是留给空闲循环中的 consolepoll() 调用 kcmd_run() 执行：
+//
+//   !help                 列出命令
+//   !lockstat [reset]     打印 / 清零锁竞争统计（-DLOCKSTAT）
+//   !keys                 列出 static key 的状态
+//   !key <name> on|off    打开 / 关闭一个 static key
+//   !trace <name|all> on|off  打开 / 关闭 tracepoint
+//   !trace dump|reset     输出 / 清空事件缓冲区
+//   !ptstat [kernel]      打印内核页表的占用与映射统计
+//   !swapstat             打印页面回收统计
+//
+// 命令在空闲循环里执行，不在中断处理程序中，可以获取锁、改写内核代码。
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "trace.h"
+
+#define MAXARGS 4
+
+extern pagetable_t kernel_pagetable; // vm.c
+
+// 按空格切分 line，返回参数个数
+static int
+kcmd_split(char *line, char **argv)
+{
+  int argc = 0;
+
+  while(*line && argc < MAXARGS){
+    while(*line == ' ')
+      *line++ = 0;
+    if(*line == 0)
+      break;
+    argv[argc++] = line;
+    while(*line && *line != ' ')
+      line++;
+  }
+  if(*line)
+    *line = 0;
+  return argc;
+}
+
+static int
+streq(char *a, char *b)
+{
+  return strncmp(a, b, 32) == 0;
+}
+
+static void
+kcmd_help(void)
+{
+  printf("kcmd: help, keys, key <name> on|off, trace <name|all> on|off, trace dump|reset, ptstat [kernel], swapstat");
+#ifdef LOCKSTAT
+  printf(", lockstat [reset]");
+#endif
+  printf("\n");
+}
+
+static void
+kcmd_key(int argc, char **argv)
+{
+  struct static_key *key;
+
+  if(argc != 3 || (!streq(argv[2], "on") && !streq(argv[2], "off"))){
+    printf("usage: key <name> on|off\n");
+    return;
+  }
+  if((key = static_key_lookup(argv[1])) == 0){
+    printf("key: no static key %s\n", argv[1]);
+    return;
+  }
+  if(streq(argv[2], "on"))
+    static_key_enable(key);
+  else
+    static_key_disable(key);
+}
+
+static void
+kcmd_trace(int argc, char **argv)
+{
+  if(argc == 2 && streq(argv[1], "dump")){
+    trace_dump();
+  } else if(argc == 2 && streq(argv[1], "reset")){
+    // trace_reset() 要求没有 CPU 正在记录
+    if(trace_active())
+      printf("trace: turn tracepoints off before reset\n");
+    else
+      trace_reset();
+  } else if(argc == 3 && streq(argv[2], "on")){
+    if(trace_enable(argv[1]) < 0)
+      printf("trace: no tracepoint %s\n", argv[1]);
+  } else if(argc == 3 && streq(argv[2], "off")){
+    if(trace_disable(argv[1]) < 0)
+      printf("trace: no tracepoint %s\n", argv[1]);
+  } else {
+    printf("usage: trace <name|all> on|off, trace dump|reset\n");
+  }
+}
+
+// 目前只有内核页表；有了进程之后可以按 pid 选择用户页表
+static void
+kcmd_ptstat(int argc, char **argv)
+{
+  if(argc == 1 || (argc == 2 && streq(argv[1], "kernel")))
+    ptstat_print("kernel", kernel_pagetable);
+  else
+    printf("usage: ptstat [kernel]\n");
+}
+
+#ifdef LOCKSTAT
+static void
+kcmd_lockstat(int argc, char **argv)
+{
+  if(argc == 1)
+    lockstat_print();
+  else if(streq(argv[1], "reset"))
+    lockstat_reset();
+  else
+    printf("usage: lockstat [reset]\n");
+}
+#endif
+
+void
+kcmd_run(char *line)
+{
+  char *argv[MAXARGS];
+  int argc = kcmd_split(line, argv);
+
+  if(argc == 0)
+    return;
+  if(streq(argv[0], "help"))
+    kcmd_help();
+  else if(streq(argv[0], "keys"))
+    static_key_print();
+  else if(streq(argv[0], "key"))
+    kcmd_key(argc, argv);
+  else if(streq(argv[0], "trace"))
+    kcmd_trace(argc, argv);
+  else if(streq(argv[0], "ptstat"))
+    kcmd_ptstat(argc, argv);
+  else if(streq(argv[0], "swapstat"))
+    swapstat_print();
+#ifdef LOCKSTAT
+  else if(streq(argv[0], "lockstat"))
+    kcmd_lockstat(argc, argv);
+#endif
+  else
+    printf("kcmd: unknown command %s, try !help\n", argv[0]);
+}
@@ -0,0 +1,161 @@
+//
+// 内核日志环。
+//
+// 每个 CPU 一个固定大小记录组成的环，本 CPU 的 printf() 是唯一的生产者，
+// 追加记录时不获取任何锁，也不等待 UART。klog_drain() 是消费者，
+// 在空闲循环里按时间戳合并各 CPU 的环，送到控制台；同一时刻只有一个 CPU 在 drain。
+//
+// 已经输出的记录留在环里，直到被新记录覆盖，panic() 用 klog_dump()
+// 打印每个 CPU 最近的 NKLOG 条记录。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "atomic.h"
+
+#define KLOG_MSG  116       // 每条记录的正文长度，整条记录 128 字节
+#define KLOG_CONT (1 << 0)  // 同一次 printf() 的后续记录
+
+struct klog_rec {
+  uint64 stamp;             // printf() 开始时的 mtime
+  ushort len;
+  ushort flags;
+  char msg[KLOG_MSG];
+};
+
+struct klog_ring {
+  uint64 head __attribute__((aligned(CACHELINE))); // 生产者写入的下一个位置
+  uint64 tail __attribute__((aligned(CACHELINE))); // 消费者读取的下一个位置
+  struct klog_rec rec[NKLOG];
+};
+
+static DEFINE_PER_CPU(struct klog_ring, klog_ring);
+
+static struct spinlock klog_lock; // 串行化消费者
+int klog_on;                      // 为 0 时 printf() 直接输出到控制台
+
+void
+klog_init(void)
+{
+  initlock(&klog_lock, "klog");
+  __sync_synchronize();
+  klog_on = 1;
+}
+
+// 把 s[0..n) 追加到本 CPU 的日志环，stamp 相同的记录属于同一次 printf()。
+// 调用者关中断。环满时先自己 drain 腾出空间，日志不会丢失。
+void
+klog_write(uint64 stamp, char *s, int n, int cont)
+{
+  struct klog_ring *r = this_cpu_ptr(klog_ring);
+  struct klog_rec *rec;
+  uint64 h;
+  int m;
+
+  while(n > 0){
+    h = r->head;
+    if(h - atomic64_load_acquire(&r->tail) == NKLOG){
+      klog_drain();
+      continue;
+    }
+
+    rec = &r->rec[h % NKLOG];
+    m = n < KLOG_MSG ? n : KLOG_MSG;
+    memmove(rec->msg, s, m);
+    rec->len = m;
+    rec->flags = cont ? KLOG_CONT : 0;
+    rec->stamp = stamp;
+    // 记录内容对消费者可见之后才移动 head
+    atomic64_store_release(&r->head, h + 1);
+
+    s += m;
+    n -= m;
+    cont = 1;
+  }
+}
+
+// 在 [from[i], to[i]) 中找时间戳最早的记录，时间相同时 CPU 号小的优先，
+// 这样同一次 printf() 的多条记录不会被拆开。没有记录时返回 -1
+static int
+klog_oldest(uint64 *from, uint64 *to)
+{
+  int best = -1;
+  uint64 stamp = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    if(from[i] == to[i])
+      continue;
+    struct klog_rec *rec = &per_cpu(klog_ring, i).rec[from[i] % NKLOG];
+    if(best < 0 || rec->stamp < stamp){
+      best = i;
+      stamp = rec->stamp;
+    }
+  }
+  return best;
+}
+
+// 把各 CPU 环中尚未输出的记录按时间顺序送到控制台
+void
+klog_drain(void)
+{
+  uint64 from[NCPU], to[NCPU];
+  struct klog_ring *r;
+  int i;
+
+  acquire(&klog_lock);
+  for(;;){
+    for(i = 0; i < NCPU; i++){
+      r = per_cpu_ptr(klog_ring, i);
+      from[i] = r->tail;
+      to[i] = atomic64_load_acquire(&r->head);
+    }
+    if((i = klog_oldest(from, to)) < 0)
+      break;
+
+    // 一次输出这个 CPU 上不晚于其他 CPU 最早记录的所有记录
+    r = per_cpu_ptr(klog_ring, i);
+    do {
+      struct klog_rec *rec = &r->rec[from[i] % NKLOG];
+      consputs(rec->msg, rec->len);
+      from[i]++;
+    } while(klog_oldest(from, to) == i);
+    atomic64_store_release(&r->tail, from[i]);
+  }
+  release(&klog_lock);
+}
+
+// panic 时打印各 CPU 保留的记录（包括已经输出过的），每次 printf() 前加
+// "[cpu 时间]" 前缀，时间以微秒为单位。不获取任何锁。
+void
+klog_dump(void)
+{
+  uint64 from[NCPU], to[NCPU];
+  char pre[40];
+  int i, n;
+
+  if(!klog_on)
+    return;
+
+  for(i = 0; i < NCPU; i++){
+    struct klog_ring *r = per_cpu_ptr(klog_ring, i);
+    to[i] = r->head;
+    from[i] = to[i] > NKLOG ? to[i] - NKLOG : 0;
+  }
+
+  printf("--- klog ---\n");
+  while((i = klog_oldest(from, to)) >= 0){
+    struct klog_rec *rec = &per_cpu(klog_ring, i).rec[from[i] % NKLOG];
+    if((rec->flags & KLOG_CONT) == 0){
+      n = snprintf(pre, sizeof(pre), "[%d %lu] ", i, rec->stamp / (TIMEBASE_HZ / 1000000));
+      consputs(pre, n);
+    }
+    consputs(rec->msg, rec->len);
+    from[i]++;
+  }
+  printf("--- end klog ---\n");
+}
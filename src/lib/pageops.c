@@ -0,0 +1,194 @@
+//
+// 页级内存操作：清零、复制、比较。
+// 启动时探测到 RVV 时使用 vecops.S 中的向量实现，
+// 否则退回 string.c 中按 64 位字处理的实现。
+// 页清零优先使用 Zicboz 的 cbo.zero。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+
+// vecops.S
+void vec_zero(void *, uint64);
+void vec_copy(void *, const void *, uint64);
+int  vec_cmp(const void *, const void *, uint64);
+
+// 内核只在这里短暂使用向量寄存器：关中断并打开 sstatus.VS，
+// 用完立即关闭。这样中断处理程序不会看到半途的向量状态，
+// 以后有了用户进程，也不需要在内核里保存用户的向量寄存器。
+static inline void
+vec_begin(void)
+{
+  push_off();
+  w_sstatus((r_sstatus() & ~SSTATUS_VS) | SSTATUS_VS_INITIAL);
+}
+
+static inline void
+vec_end(void)
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+  pop_off();
+}
+
+// 把 dst 开始的 n 字节清零
+void
+blk_zero(void *dst, uint64 n)
+{
+  if(cpufeatures & CPUF_V){
+    vec_begin();
+    vec_zero(dst, n);
+    vec_end();
+  } else {
+    memset(dst, 0, n);
+  }
+}
+
+// 复制 n 字节，源和目的不能重叠
+void
+blk_copy(void *dst, const void *src, uint64 n)
+{
+  if(cpufeatures & CPUF_V){
+    vec_begin();
+    vec_copy(dst, src, n);
+    vec_end();
+  } else {
+    memmove(dst, src, n);
+  }
+}
+
+// 与 memcmp 相同的比较
+int
+blk_cmp(const void *a, const void *b, uint64 n)
+{
+  int r;
+
+  if(cpufeatures & CPUF_V){
+    vec_begin();
+    r = vec_cmp(a, b, n);
+    vec_end();
+  } else {
+    r = memcmp(a, b, n);
+  }
+  return r;
+}
+
+// 清零一个物理页。
+// 有 Zicboz 时每条 cbo.zero 直接清零一个缓存块，不需要先把旧内容读进缓存
+void
+page_zero(void *pa)
+{
+  char *p;
+
+  if(cpufeatures & CPUF_ZICBOZ){
+    for(p = pa; p < (char *)pa + PGSIZE; p += 4 * CBOZ_BLOCK_SIZE){
+      cbo_zero(p);
+      cbo_zero(p + CBOZ_BLOCK_SIZE);
+      cbo_zero(p + 2 * CBOZ_BLOCK_SIZE);
+      cbo_zero(p + 3 * CBOZ_BLOCK_SIZE);
+    }
+  } else {
+    blk_zero(pa, PGSIZE);
+  }
+}
+
+void
+page_copy(void *dst, const void *src)
+{
+  blk_copy(dst, src, PGSIZE);
+}
+
+int
+page_cmp(const void *a, const void *b)
+{
+  return blk_cmp(a, b, PGSIZE);
+}
+
+#ifdef PAGEOPS_BENCH
+//
+// 标量与向量实现的吞吐量对比，在 Makefile 中打开 -DPAGEOPS_BENCH 后
+// 由 main() 在启动时调用一次。
+//
+
+#define BENCH_BIG (2 * 1024 * 1024)
+
+static char bench_src[BENCH_BIG] __attribute__((aligned(PGSIZE)));
+static char bench_dst[BENCH_BIG] __attribute__((aligned(PGSIZE)));
+
+enum { OP_ZERO, OP_COPY, OP_CMP, NOP };
+static char *opname[NOP] = {"zero", "copy", "cmp"};
+
+// 连续执行 iters 次操作，返回消耗的 mtime 计数
+static uint64
+bench_run(int op, int vector, uint64 n, int iters)
+{
+  uint64 t0, t1;
+
+  if(vector)
+    vec_begin();
+  t0 = r_time();
+  for(int i = 0; i < iters; i++){
+    switch(op){
+    case OP_ZERO:
+      if(vector)
+        vec_zero(bench_dst, n);
+      else
+        memset(bench_dst, 0, n);
+      break;
+    case OP_COPY:
+      if(vector)
+        vec_copy(bench_dst, bench_src, n);
+      else
+        memmove(bench_dst, bench_src, n);
+      break;
+    case OP_CMP:
+      // 两块内容相同，比较必须扫完全部字节
+      if((vector ? vec_cmp(bench_dst, bench_src, n) : memcmp(bench_dst, bench_src, n)) != 0)
+        panic("pageops_bench: cmp");
+      break;
+    }
+  }
+  t1 = r_time();
+  if(vector)
+    vec_end();
+  return t1 - t0;
+}
+
+// 吞吐量，单位 MB/s
+static int
+bench_mbps(uint64 n, int iters, uint64 dt)
+{
+  if(dt == 0)
+    dt = 1;
+  return (int)(n * iters * TIMEBASE_HZ / dt / (1024 * 1024));
+}
+
+void
+pageops_bench(void)
+{
+  static struct { uint64 n; int iters; char *name; } sizes[] = {
+    { PGSIZE, 512, "4K" },
+    { BENCH_BIG, 16, "2M" },
+  };
+  uint64 dt;
+
+  printf("pageops bench (vector %s):\n", (cpufeatures & CPUF_V) ? "on" : "off");
+  for(int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+    for(int op = 0; op < NOP; op++){
+      memset(bench_src, 0, sizes[s].n);
+      memset(bench_dst, 0, sizes[s].n);
+      dt = bench_run(op, 0, sizes[s].n, sizes[s].iters);
+      printf("  %s %s: scalar %d MB/s", opname[op], sizes[s].name,
+             bench_mbps(sizes[s].n, sizes[s].iters, dt));
+      if(cpufeatures & CPUF_V){
+        dt = bench_run(op, 1, sizes[s].n, sizes[s].iters);
+        printf(", vector %d MB/s", bench_mbps(sizes[s].n, sizes[s].iters, dt));
+      }
+      printf("\n");
+    }
+  }
+}
+#endif // PAGEOPS_BENCH
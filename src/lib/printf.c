@@ -1,8 +1,12 @@
 //
-// 格式化控制台输出 -- printf, panic
+// 格式化控制台输出 -- printf, snprintf, panic
 // 提供内核级别的格式化输出功能，支持基本的格式说明符
 // 包括整数、十六进制、指针和字符串输出
 //
+// printf 先把整条消息格式化到本 CPU 的缓冲区里（不持有任何锁），
+// 然后一次性交给控制台输出，而不是每个字符都走一遍 UART 锁。
+// 启动完成后（klog_on）改为追加到本 CPU 的日志环，由空闲的 CPU 输出，见 klog.c。
+//
 
 #include <stdarg.h>
 
@@ -16,6 +20,7 @@
 #include "proc.h"
 
 // 全局 panic 状态标志，用于冻结其他 CPU 的输出
+volatile int panicking = 0; // panic 正在输出信息，控制台改用同步输出
 volatile int panicked = 0;
 
 // printf 锁机制，防止并发 printf 调用时输出交错
@@ -27,17 +32,40 @@ static struct {
 // 数字转换时使用的字符表（支持 16 进制）
 static char digits[] = "0123456789abcdef";
 
-// 打印整数到控制台
+// 格式化输出的目的缓冲区
+// 写满时若有 flush 则交给它输出并清空，否则截断（snprintf）
+struct outbuf {
+  char *buf;
+  int size;                   // 缓冲区大小
+  int len;                    // 缓冲区中已有的字节数
+  int total;                  // 格式化产生的总字节数（含截断部分）
+  void (*flush)(struct outbuf *);
+  int locked;                 // printflush 是否已获取 pr.lock
+  uint64 stamp;               // printf 开始的时间，日志环记录用
+  int nflush;                 // 已经 flush 的次数
+};
+
+static void
+outc(struct outbuf *ob, char c)
+{
+  if(ob->len == ob->size && ob->flush)
+    ob->flush(ob);
+  if(ob->len < ob->size)
+    ob->buf[ob->len++] = c;
+  ob->total++;
+}
+
+// 输出整数
 // 参数：
-//   xx: 要打印的整数值
+//   xx: 要输出的整数值
 //   base: 进制基数（10=十进制，16=十六进制）
 //   sign: 是否处理符号（1=有符号，0=无符号）
 static void
-printint(int xx, int base, int sign)
+printint(struct outbuf *ob, long xx, int base, int sign)
 {
-  char buf[16];  // 数字字符缓冲区（足够存储 64 位数字）
+  char buf[24];  // 数字字符缓冲区（足够存储 64 位十进制数和符号）
   int i;
-  uint x;
+  uint64 x;
 
   // 处理负数：如果是有符号数且为负，转换为正数并记录符号
   if(sign && (sign = xx < 0))
@@ -57,101 +85,184 @@ printint(int xx, int base, int sign)
 
   // 逆序输出字符（因为之前是逆序存储的）
   while(--i >= 0)
-    consputc(buf[i]);
+    outc(ob, buf[i]);
 }
 
-// 打印指针地址到控制台（格式：0x[16位十六进制]）
+// 输出指针地址（格式：0x[16位十六进制]）
 // 参数：
-//   x: 要打印的指针值（64位地址）
+//   x: 要输出的指针值（64位地址）
 static void
-printptr(uint64 x)
+printptr(struct outbuf *ob, uint64 x)
 {
   int i;
-  
+
   // 输出 "0x" 前缀
-  consputc('0');
-  consputc('x');
-  
+  outc(ob, '0');
+  outc(ob, 'x');
+
   // 输出 16 个十六进制数字（64位地址）
   // 从最高位开始，每次取4位转换为十六进制字符
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    outc(ob, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// 格式化输出到控制台
-// 支持的格式说明符：%d(十进制), %x(十六进制), %p(指针), %s(字符串), %%(百分号)
-// 参数：
-//   fmt: 格式字符串
-//   ...: 可变参数列表
-void
-printf(char *fmt, ...)
+// 格式化引擎
+// 支持的格式说明符：%d(十进制), %u(无符号十进制), %x(十六进制),
+// %p(指针), %s(字符串), %c(字符), %%(百分号)
+// %d/%u/%x 前可加 l 表示 64 位参数，如 %ld、%lu、%lx
+static void
+vprintfmt(struct outbuf *ob, char *fmt, va_list ap)
 {
-  va_list ap;           // 可变参数列表指针
-  int i, c, locking;
+  int i, c, lng;
+  long v;
   char *s;
 
-  // 获取当前锁定状态
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);  // 获取 printf 锁，防止输出交错
-
   // 检查格式字符串有效性
   if (fmt == 0)
     panic("null fmt");
 
-  // 初始化可变参数处理
-  va_start(ap, fmt);
-  
   // 逐字符处理格式字符串
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
       // 普通字符，直接输出
-      consputc(c);
+      outc(ob, c);
       continue;
     }
-    
+
     // 处理格式说明符
     c = fmt[++i] & 0xff;
+    lng = 0;
+    if(c == 'l'){
+      lng = 1;
+      c = fmt[++i] & 0xff;
+    }
     if(c == 0)
       break;  // 格式字符串结束
-      
+
     switch(c){
     case 'd':
       // %d: 十进制有符号整数
-      printint(va_arg(ap, int), 10, 1);
+      v = lng ? va_arg(ap, long) : va_arg(ap, int);
+      printint(ob, v, 10, 1);
+      break;
+    case 'u':
+      // %u: 十进制无符号整数
+      v = lng ? va_arg(ap, uint64) : va_arg(ap, uint);
+      printint(ob, v, 10, 0);
       break;
     case 'x':
       // %x: 十六进制整数
-      printint(va_arg(ap, int), 16, 1);
+      v = lng ? va_arg(ap, uint64) : va_arg(ap, uint);
+      printint(ob, v, 16, 0);
       break;
     case 'p':
       // %p: 指针地址
-      printptr(va_arg(ap, uint64));
+      printptr(ob, va_arg(ap, uint64));
       break;
     case 's':
       // %s: 字符串
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";  // 空指针处理
       for(; *s; s++)
-        consputc(*s);
+        outc(ob, *s);
+      break;
+    case 'c':
+      // %c: 单个字符
+      outc(ob, va_arg(ap, int));
       break;
     case '%':
       // %%: 输出百分号字面量
-      consputc('%');
+      outc(ob, '%');
       break;
     default:
       // 未知格式说明符，输出 %c 以引起注意
-      consputc('%');
-      consputc(c);
+      outc(ob, '%');
+      outc(ob, c);
       break;
     }
   }
-  
+}
+
+// 格式化到 buf 中，最多写入 size - 1 个字符并以 '\0' 结尾
+// 返回完整输出所需的字符数（不含 '\0'），大于等于 size 表示被截断
+int
+vsnprintf(char *buf, int size, char *fmt, va_list ap)
+{
+  struct outbuf ob = { buf, size > 0 ? size - 1 : 0, 0, 0, 0, 0, 0, 0 };
+
+  vprintfmt(&ob, fmt, ap);
+  if(size > 0)
+    buf[ob.len] = '\0';
+  return ob.total;
+}
+
+int
+snprintf(char *buf, int size, char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, size, fmt, ap);
+  va_end(ap);
+  return n;
+}
+
+// 把本 CPU 缓冲区中已格式化的内容一次性送到控制台
+// 第一次输出时才获取 printf 锁，一直持有到 printf 结束，
+// 这样超过缓冲区长度的消息也不会和其他 CPU 的输出交错。
+// 日志环打开时只追加到本 CPU 的环，不获取锁
+static void
+printflush(struct outbuf *ob)
+{
+  if(klog_on && !panicking){
+    klog_write(ob->stamp, ob->buf, ob->len, ob->nflush++ > 0);
+    ob->len = 0;
+    return;
+  }
+  if(pr.locking && !ob->locked){
+    acquire(&pr.lock);
+    ob->locked = 1;
+  }
+  consputs(ob->buf, ob->len);
+  ob->len = 0;
+}
+
+// 格式化输出到控制台
+// 参数：
+//   fmt: 格式字符串
+//   ...: 可变参数列表
+void
+printf(char *fmt, ...)
+{
+  va_list ap;           // 可变参数列表指针
+  struct outbuf ob;
+
+  // 关中断：本 CPU 的缓冲区不能被中断处理程序里的 printf 重入
+  push_off();
+
+  ob.buf = mycpu()->printbuf;
+  ob.size = PRINTBUF_SIZE;
+  ob.len = 0;
+  ob.total = 0;
+  ob.flush = printflush;
+  ob.locked = 0;
+  ob.stamp = r_time();
+  ob.nflush = 0;
+
+  // 初始化可变参数处理
+  va_start(ap, fmt);
+  vprintfmt(&ob, fmt, ap);
   va_end(ap);  // 清理可变参数
 
+  if(ob.len > 0)
+    printflush(&ob);
+
   // 释放锁
-  if(locking)
+  if(ob.locked)
     release(&pr.lock);
+
+  pop_off();
 }
 
 // 系统 panic 处理函数
@@ -161,12 +272,15 @@ printf(char *fmt, ...)
 void
 panic(char *s)
 {
+  panicking = 1;      // 不再经过 uart 发送缓冲区和中断
   pr.locking = 0;     // 禁用锁定，确保 panic 信息能够输出
   printf("panic: ");   // 输出 panic 前缀
   printf(s);          // 输出具体的 panic 消息
   printf("\n");       // 换行
+  klog_dump();        // 日志环中保留的最近记录，包括还没输出的
+  trace_dump();       // 打开过 tracepoint 时导出事件缓冲区
   panicked = 1;       // 设置全局 panic 标志，冻结其他 CPU 的 UART 输出
-  
+
   // 进入无限循环，停止系统运行
   for(;;)
     ;
@@ -177,6 +291,6 @@ panic(char *s)
 void
 printfinit(void)
 {
-  initlock(&pr.lock, "pr");  // 初始化 printf 锁
+  initlock_kind(&pr.lock, "pr", SPIN_TICKET);  // 初始化 printf 锁，按到达顺序输出
   pr.locking = 1;            // 启用锁定机制
 }
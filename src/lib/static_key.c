@@ -0,0 +1,116 @@
+//
+// 改写 static key 使用点的指令。
+// 内核代码段映射为只读，改写时临时把目标页映射到 TEXTPOKE 这个
+// 可写的别名地址上，写完立即拆除映射。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "static_key.h"
+
+#define INSN_NOP 0x00000013 // addi x0, x0, 0
+
+struct static_key debug_checks = STATIC_KEY_INIT_TRUE("debug_checks");
+struct static_key walk_debug = STATIC_KEY_INIT_FALSE("walk_debug");
+
+// 所有 key，供控制台命令（!keys、!key，见 kcmd.c）按名字查找
+static struct static_key *keys[] = { &debug_checks, &walk_debug };
+
+extern struct jump_entry __jump_table_start[], __jump_table_end[]; // kernel.ld
+extern pagetable_t kernel_pagetable; // vm.c
+
+// 串行化所有的代码改写
+static struct spinlock text_lock;
+
+void
+static_key_init(void)
+{
+  initlock(&text_lock, "text");
+}
+
+// jal x0, target 的编码
+static uint32
+insn_j(uint64 pc, uint64 target)
+{
+  long off = target - pc;
+
+  if(off >= (1L << 20) || off < -(1L << 20))
+    panic("static_key: jump out of range");
+  return ((off >> 20) & 1) << 31 | ((off >> 1) & 0x3ff) << 21 |
+         ((off >> 11) & 1) << 20 | ((off >> 12) & 0xff) << 12 | 0x6f;
+}
+
+// 把 addr 处的一条指令改成 insn。调用者持有 text_lock
+static void
+text_poke(uint64 addr, uint32 insn)
+{
+  pte_t *pte;
+
+  if(r_satp() == 0){
+    // 还没有开启分页，直接写物理地址
+    *(volatile uint32 *)addr = insn;
+    return;
+  }
+
+  if((pte = walk(kernel_pagetable, TEXTPOKE, 1)) == 0)
+    panic("text_poke: walk");
+  *pte = PA2PTE(PGROUNDDOWN(addr)) | PTE_R | PTE_W | PTE_V;
+  sfence_vma();
+  *(volatile uint32 *)(TEXTPOKE + (addr % PGSIZE)) = insn;
+  *pte = 0;
+  sfence_vma();
+}
+
+static void
+static_key_set(struct static_key *key, int on)
+{
+  struct jump_entry *e;
+
+  acquire(&text_lock);
+  if(key->enabled != on){
+    key->enabled = on;
+    for(e = __jump_table_start; e < __jump_table_end; e++){
+      if(e->key == (uint64)key)
+        text_poke(e->code, on ? insn_j(e->code, e->target) : INSN_NOP);
+    }
+  }
+  fence_i();
+  release(&text_lock);
+
+  // 其他 CPU 在 softintr() 中执行 fence.i
+  ipi_send_others(IPI_FENCE_I);
+}
+
+void
+static_key_enable(struct static_key *key)
+{
+  static_key_set(key, 1);
+}
+
+void
+static_key_disable(struct static_key *key)
+{
+  static_key_set(key, 0);
+}
+
+// 按名字查找 key，找不到返回 0
+struct static_key *
+static_key_lookup(char *name)
+{
+  for(int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    if(strncmp(keys[i]->name, name, 32) == 0)
+      return keys[i];
+  return 0;
+}
+
+// 打印所有 key 的状态
+void
+static_key_print(void)
+{
+  for(int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    printf("static key %s: %s\n", keys[i]->name, keys[i]->enabled ? "on" : "off");
+}
@@ -0,0 +1,70 @@
+#ifndef XV6_STATIC_KEY_H
+#define XV6_STATIC_KEY_H
+
+#include "types.h"
+
+// Static keys: runtime-patched branches.
+//
+//   if(static_key_true(&debug_checks) && holding(lk))
+//     panic("acquire");
+//
+// 每个使用点编译成一条 4 字节指令：key 为真时是跳到分支体的 j，
+// 为假时是 nop，不读内存也不做比较。位置记录在 __jump_table 段中，
+// static_key_enable()/static_key_disable() 改写所有使用点的指令，
+// 并让所有 CPU 执行 fence.i。
+//
+// static_key_true() 用于初值为真的 key，static_key_false() 用于初值为假的 key，
+// 这样编译出的指令与 key 的初值一致，不需要在启动时改写。
+
+struct static_key {
+  int enabled;
+  char *name;
+};
+
+#define STATIC_KEY_INIT_TRUE(name)  { 1, name }
+#define STATIC_KEY_INIT_FALSE(name) { 0, name }
+
+// __jump_table 中的一项
+struct jump_entry {
+  uint64 code;       // 被改写的指令的地址
+  uint64 target;     // key 为真时跳转的目标
+  uint64 key;        // struct static_key 的地址
+};
+
+// 对齐到 4 字节且不压缩，改写时一次写入完整的一条指令
+#define __STATIC_BRANCH_ASM(insn)               \
+  ".balign 4\n"                                 \
+  ".option push\n"                              \
+  ".option norelax\n"                           \
+  ".option norvc\n"                             \
+  "1: " insn "\n"                               \
+  ".option pop\n"                               \
+  ".pushsection __jump_table, \"aw\"\n"         \
+  ".balign 8\n"                                 \
+  ".dword 1b, %l[l_yes], %0\n"                  \
+  ".popsection\n"
+
+static inline __attribute__((always_inline)) int
+static_key_false(struct static_key *key)
+{
+  asm goto(__STATIC_BRANCH_ASM("nop") : : "i" (key) : : l_yes);
+  return 0;
+l_yes:
+  return 1;
+}
+
+static inline __attribute__((always_inline)) int
+static_key_true(struct static_key *key)
+{
+  asm goto(__STATIC_BRANCH_ASM("j %l[l_yes]") : : "i" (key) : : l_yes);
+  return 0;
+l_yes:
+  return 1;
+}
+
+// 锁、中断嵌套和物理页分配器的调试检查，默认打开
+extern struct static_key debug_checks;
+// walk() 对 TRAMPOLINE 的调试输出，默认关闭
+extern struct static_key walk_debug;
+
+#endif // XV6_STATIC_KEY_H
@@ -1,13 +1,62 @@
 #include "types.h"
 
+// 按 64 位字处理的辅助定义。
+// 两个指针只有在低 3 位相同时才能同时对齐到字边界，
+// 否则退回逐字节处理（RISC-V 的非对齐访问可能陷入或很慢）。
+#define WSIZE     sizeof(uint64)
+#define WMASK     (WSIZE - 1)
+#define BLKSIZE   (8 * WSIZE)   // 展开循环一次处理 64 字节
+#define ONES      0x0101010101010101UL
+#define HIGHS     0x8080808080808080UL
+
+// 字 w 中是否有值为 0 的字节
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+static inline int
+aligned(const void *p)
+{
+  return ((uint64)p & WMASK) == 0;
+}
+
+// 两个指针能否同时对齐到字边界
+static inline int
+coaligned(const void *a, const void *b)
+{
+  return (((uint64)a ^ (uint64)b) & WMASK) == 0;
+}
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *cdst = (uchar *) dst;
+  uint64 w, *wdst;
+
+  // 头部：逐字节写到字边界
+  while(n > 0 && !aligned(cdst)){
+    *cdst++ = c;
+    n--;
   }
+
+  if(n >= WSIZE){
+    // 把字节复制到字的每一个字节上
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+
+    wdst = (uint64 *) cdst;
+    for(; n >= BLKSIZE; n -= BLKSIZE, wdst += 8){
+      wdst[0] = w; wdst[1] = w; wdst[2] = w; wdst[3] = w;
+      wdst[4] = w; wdst[5] = w; wdst[6] = w; wdst[7] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wdst++ = w;
+    cdst = (uchar *) wdst;
+  }
+
+  // 尾部
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +67,21 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+
+  if(coaligned(s1, s2)){
+    while(n > 0 && !aligned(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    // 逐字比较，遇到不同的字后交给下面的逐字节比较找出差异字节
+    while(n >= WSIZE && *(const uint64 *)s1 == *(const uint64 *)s2){
+      s1 += WSIZE;
+      s2 += WSIZE;
+      n -= WSIZE;
+    }
+  }
+
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -27,6 +91,61 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// 向高地址方向复制
+static void
+copy_forward(char *d, const char *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  if(coaligned(d, s)){
+    while(n > 0 && !aligned(d)){
+      *d++ = *s++;
+      n--;
+    }
+    wd = (uint64 *) d;
+    ws = (const uint64 *) s;
+    for(; n >= BLKSIZE; n -= BLKSIZE, wd += 8, ws += 8){
+      wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+      wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = *ws++;
+    d = (char *) wd;
+    s = (const char *) ws;
+  }
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+// 向低地址方向复制，d 和 s 指向区域的末尾
+static void
+copy_backward(char *d, const char *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  if(coaligned(d, s)){
+    while(n > 0 && !aligned(d)){
+      *--d = *--s;
+      n--;
+    }
+    wd = (uint64 *) d;
+    ws = (const uint64 *) s;
+    for(; n >= BLKSIZE; n -= BLKSIZE){
+      wd -= 8, ws -= 8;
+      wd[7] = ws[7]; wd[6] = ws[6]; wd[5] = ws[5]; wd[4] = ws[4];
+      wd[3] = ws[3]; wd[2] = ws[2]; wd[1] = ws[1]; wd[0] = ws[0];
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *--wd = *--ws;
+    d = (char *) wd;
+    s = (const char *) ws;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
@@ -35,17 +154,13 @@ memmove(void *dst, const void *src, uint n)
 
   if(n == 0)
     return dst;
-  
+
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  if(s < d && s + n > d)
+    copy_backward(d + n, s + n, n);
+  else
+    copy_forward(d, s, n);
 
   return dst;
 }
@@ -60,6 +175,21 @@ memcpy(void *dst, const void *src, uint n)
 int
 strncmp(const char *p, const char *q, uint n)
 {
+  if(coaligned(p, q)){
+    while(n > 0 && !aligned(p)){
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+      n--, p++, q++;
+    }
+    // 两个字相同且不含 0 字节时整字跳过
+    while(n >= WSIZE){
+      uint64 w = *(const uint64 *)p;
+      if(w != *(const uint64 *)q || HASZERO(w))
+        break;
+      n -= WSIZE, p += WSIZE, q += WSIZE;
+    }
+  }
+
   while(n > 0 && *p && *p == *q)
     n--, p++, q++;
   if(n == 0)
@@ -98,10 +228,20 @@ safestrcpy(char *s, const char *t, int n)
 int
 strlen(const char *s)
 {
-  int n;
+  const char *p = s;
+  const uint64 *w;
 
-  for(n = 0; s[n]; n++)
+  while(!aligned(p)){
+    if(*p == 0)
+      return p - s;
+    p++;
+  }
+
+  // 对齐的整字读取不会越过页边界，可以安全地读到结尾之后
+  for(w = (const uint64 *) p; !HASZERO(*w); w++)
     ;
-  return n;
-}
 
+  for(p = (const char *) w; *p; p++)
+    ;
+  return p - s;
+}
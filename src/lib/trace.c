@@ -0,0 +1,149 @@
+//
+// Tracepoint 的事件缓冲区和导出，见 trace.h。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "trace.h"
+
+struct static_key trace_keys[NTRACE] = {
+  [TRACE_TRAP_ENTER] = STATIC_KEY_INIT_FALSE("trap_enter"),
+  [TRACE_TRAP_EXIT]  = STATIC_KEY_INIT_FALSE("trap_exit"),
+  [TRACE_KALLOC]     = STATIC_KEY_INIT_FALSE("kalloc"),
+  [TRACE_KFREE]      = STATIC_KEY_INIT_FALSE("kfree"),
+  [TRACE_LOCK_WAIT]  = STATIC_KEY_INIT_FALSE("lock_wait"),
+};
+
+// 每个 CPU 一个缓冲区，只有本 CPU 写入。
+// 布局由 tools/trace2json.py 直接解析，修改时要同步修改它
+struct trace_buf {
+  uint64 head __attribute__((aligned(CACHELINE))); // 已写入的事件总数
+  struct trace_event ev[NTRACEBUF] __attribute__((aligned(CACHELINE)));
+};
+
+static DEFINE_PER_CPU(struct trace_buf, trace_buf);
+
+static int trace_used; // 打开过 tracepoint 才需要导出
+
+// 追加一个事件。关中断，防止与本 CPU 上的中断处理程序交错写入
+void
+trace_record(uint id, uint64 a0, uint64 a1)
+{
+  struct trace_buf *b;
+  struct trace_event *e;
+
+  push_off();
+  b = this_cpu_ptr(trace_buf);
+  e = &b->ev[b->head % NTRACEBUF];
+  e->stamp = r_time();
+  e->id = id;
+  e->resv = 0;
+  e->a0 = a0;
+  e->a1 = a1;
+  b->head++;
+  pop_off();
+}
+
+// 打开名为 name 的 tracepoint，"all" 表示全部。找不到返回 -1
+int
+trace_enable(char *name)
+{
+  int found = -1;
+
+  for(int i = 0; i < NTRACE; i++){
+    if(strncmp(name, "all", 4) == 0 || strncmp(name, trace_keys[i].name, 32) == 0){
+      trace_used = 1;
+      static_key_enable(&trace_keys[i]);
+      found = 0;
+    }
+  }
+  return found;
+}
+
+int
+trace_disable(char *name)
+{
+  int found = -1;
+
+  for(int i = 0; i < NTRACE; i++){
+    if(strncmp(name, "all", 4) == 0 || strncmp(name, trace_keys[i].name, 32) == 0){
+      static_key_disable(&trace_keys[i]);
+      found = 0;
+    }
+  }
+  return found;
+}
+
+// 按位打开 tracepoint：mask 的第 i 位对应事件 i
+void
+trace_enable_mask(uint mask)
+{
+  for(int i = 0; i < NTRACE; i++){
+    if(mask & (1 << i)){
+      trace_used = 1;
+      static_key_enable(&trace_keys[i]);
+    }
+  }
+}
+
+// 是否有打开的 tracepoint
+int
+trace_active(void)
+{
+  for(int i = 0; i < NTRACE; i++)
+    if(trace_keys[i].enabled)
+      return 1;
+  return 0;
+}
+
+// 清空所有缓冲区。调用者保证此时没有 CPU 在记录事件
+void
+trace_reset(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    per_cpu(trace_buf, i).head = 0;
+}
+
+// 以十六进制在控制台输出所有缓冲区中的事件：
+//   trace: begin hz=<mtime 频率> ncpu=<n>
+//   trace: event <id> <name>
+//   T <cpu> <stamp> <id> <a0> <a1>
+//   trace: end
+// 也可以用 QEMU monitor 的 pmemsave 直接保存 trace_buf 所在内存，
+// 地址和大小见 trace_print_layout()
+void
+trace_dump(void)
+{
+  if(!trace_used)
+    return;
+
+  printf("trace: begin hz=%lu ncpu=%d\n", (uint64)TIMEBASE_HZ, NCPU);
+  for(int i = 0; i < NTRACE; i++)
+    printf("trace: event %d %s\n", i, trace_keys[i].name);
+
+  for(int cpu = 0; cpu < NCPU; cpu++){
+    struct trace_buf *b = per_cpu_ptr(trace_buf, cpu);
+    uint64 head = b->head;
+    uint64 n = head < NTRACEBUF ? head : NTRACEBUF;
+
+    for(uint64 i = head - n; i < head; i++){
+      struct trace_event *e = &b->ev[i % NTRACEBUF];
+      printf("T %d %lx %x %lx %lx\n", cpu, e->stamp, e->id, e->a0, e->a1);
+    }
+  }
+  printf("trace: end\n");
+}
+
+// 打印 CPU 0 缓冲区的物理地址、CPU 之间的距离和每个缓冲区的事件数，
+// 供 pmemsave 和 trace2json.py --raw 使用
+void
+trace_print_layout(void)
+{
+  printf("trace: buffers at %p stride %lu nevent %d\n",
+         (uint64)per_cpu_ptr(trace_buf, 0), PERCPU_STRIDE, NTRACEBUF);
+}
@@ -0,0 +1,50 @@
+#ifndef XV6_TRACE_H
+#define XV6_TRACE_H
+
+#include "types.h"
+#include "static_key.h"
+
+// Tracepoints.
+//
+//   trace(TRACE_KFREE, pa, 0);
+//
+// 每个 tracepoint 由一个 static key 控制，关闭时使用点只有一条 nop。
+// 打开后把一条 32 字节的二进制事件写入本 CPU 的环形缓冲区，
+// 时间戳是 mtime；缓冲区写满后覆盖最旧的事件。
+// trace_dump() 以十六进制输出所有缓冲区，tools/trace2json.py 把它
+// 转成 Chrome / Perfetto 可以打开的 JSON。
+//
+// 运行时用控制台命令 "!trace <name|all> on|off" 打开或关闭（见 kcmd.c）；
+// 编译时加 -DTRACE 在启动后打开全部 tracepoint，
+// 再加 -DTRACE_MASK=<位掩码> 只打开掩码中的事件（第 i 位对应事件 i）。
+// 注意 trap_enter/trap_exit 打开时 kerneltrap_fast() 不再生效，
+// 所有内核中断都走保存全部寄存器的慢路径。
+
+#define TRACE_TRAP_ENTER 0   // a0 = scause, a1 = sepc
+#define TRACE_TRAP_EXIT  1   // a0 = scause
+#define TRACE_KALLOC     2   // a0 = pa
+#define TRACE_KFREE      3   // a0 = pa
+#define TRACE_LOCK_WAIT  4   // a0 = struct spinlock*, a1 = 等待的 mtime 周期数
+#define NTRACE           5
+
+struct trace_event {
+  uint64 stamp;
+  uint id;
+  uint resv;
+  uint64 a0;
+  uint64 a1;
+};
+
+extern struct static_key trace_keys[NTRACE];
+
+void trace_record(uint id, uint64 a0, uint64 a1);
+
+// ev 必须是编译期常量
+#define trace(ev, a0, a1) do {                          \
+  if(static_key_false(&trace_keys[ev]))                 \
+    trace_record((ev), (uint64)(a0), (uint64)(a1));     \
+} while(0)
+
+#define trace_enabled(ev) static_key_false(&trace_keys[ev])
+
+#endif // XV6_TRACE_H
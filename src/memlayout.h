@@ -27,9 +27,13 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // 写 1 向该 hart 发机器模式软件中断
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
+// qemu virt 的 mtime（即 rdtime）计数频率
+#define TIMEBASE_HZ 10000000L
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
@@ -56,6 +60,9 @@
 // 用户空间和内核空间均可访问；占用最高地址的一页大小
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
+// 改写内核代码时临时映射目标页的可写别名，位于 KERNBASE 之下的空洞中
+#define TEXTPOKE (KERNBASE - PGSIZE)
+
 // 每个内核栈占用 2 页空间，其中一页用于实际的栈，另一页作为无效的“guard page”（保护页）
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
 
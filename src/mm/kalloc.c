@@ -8,6 +8,8 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "static_key.h"
+#include "trace.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -27,7 +29,7 @@ struct
 
 void kinit()
 {
-    initlock(&kmem.lock, "kmem");
+    initlock_kind(&kmem.lock, "kmem", SPIN_MCS);
     freerange(end, (void *)PHYSTOP);
 }
 
@@ -47,11 +49,17 @@ void kfree(void *pa)
 {
     struct run *r;
 
-    if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP)
-        panic("kfree");
+    // 检查和填充垃圾数据只在打开 debug_checks 时进行
+    if (static_key_true(&debug_checks))
+    {
+        if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP)
+            panic("kfree");
 
-    // Fill with junk to catch dangling refs.
-    memset(pa, 1, PGSIZE);
+        // Fill with junk to catch dangling refs.
+        memset(pa, 1, PGSIZE);
+    }
+
+    trace(TRACE_KFREE, pa, 0);
 
     //   pa 对应的页被释放
     r = (struct run *)pa;
@@ -63,11 +71,9 @@ void kfree(void *pa)
     release(&kmem.lock);
 }
 
-// Allocate one 4096-byte page of physical memory.
-// Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
-void *
-kalloc(void)
+// 从空闲链表头部取下一页，链表为空时返回 0
+static struct run *
+kmem_pop(void)
 {
     struct run *r;
 
@@ -76,8 +82,25 @@ kalloc(void)
     if (r)
         kmem.freelist = r->next;
     release(&kmem.lock);
+    return r;
+}
 
-    if (r)
+// Allocate one 4096-byte page of physical memory.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc(void)
+{
+    struct run *r;
+
+    r = kmem_pop();
+    // 空闲链表耗尽时，先把冷的用户页面换出到交换区再重试
+    if (r == 0 && reclaim(RECLAIM_BATCH) > 0)
+        r = kmem_pop();
+
+    if (r && static_key_true(&debug_checks))
         memset((char *)r, 5, PGSIZE); // fill with junk
+    if (r)
+        trace(TRACE_KALLOC, r, 0);
     return (void *)r;
 }
@@ -0,0 +1,98 @@
+// 页表检查器：统计一棵页表的占用和映射情况。
+// ptstat_collect() 供基准测试读取数据，ptstat_print() 打印到控制台，
+// 用于确认大页映射、共享代码页等优化确实生效。
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "ptstat.h"
+
+// 各级叶子映射覆盖的字节数
+static inline uint64
+level_size(int level)
+{
+    return 1L << PXSHIFT(level);
+}
+
+static void
+collect(pagetable_t pagetable, int level, struct ptstat *st)
+{
+    st->tables[level]++;
+
+    for (int i = 0; i < 512; i++)
+    {
+        pte_t pte = pagetable[i];
+
+        if ((pte & PTE_V) == 0)
+        {
+            if (pte & PTE_SWAP)
+                st->swapped++;
+            continue;
+        }
+
+        if ((pte & (PTE_R | PTE_W | PTE_X)) == 0)
+        {
+            // 指向下一级页表
+            st->interior[level]++;
+            if (level == 0)
+                panic("ptstat: pointer PTE at level 0");
+            collect((pagetable_t)PTE2PA(pte), level - 1, st);
+            continue;
+        }
+
+        st->leaves[level]++;
+        st->perm[(pte >> 1) & 7]++;
+        st->mapped += level_size(level);
+        if (pte & PTE_U)
+            st->user++;
+        if (pte & PTE_G)
+            st->global++;
+        if (pte & PTE_A)
+            st->accessed++;
+        if (pte & PTE_D)
+            st->dirty++;
+        if (pte & PTE_SHARED)
+            st->shared++;
+    }
+}
+
+// 遍历整棵页表，填写统计结果
+void ptstat_collect(pagetable_t pagetable, struct ptstat *st)
+{
+    memset(st, 0, sizeof(*st));
+    collect(pagetable, PT_LEVELS - 1, st);
+}
+
+// 打印页表 pagetable 的统计信息，name 用于标识这棵页表
+void ptstat_print(char *name, pagetable_t pagetable)
+{
+    static char *permname[8] = {"---", "r--", "-w-", "rw-", "--x", "r-x", "-wx", "rwx"};
+    static char *sizename[PT_LEVELS] = {"4K", "2M", "1G"};
+    struct ptstat st;
+    uint64 ntables = 0;
+
+    ptstat_collect(pagetable, &st);
+
+    printf("pagetable %s (%p):\n", name, pagetable);
+    for (int level = PT_LEVELS - 1; level >= 0; level--)
+    {
+        ntables += st.tables[level];
+        printf("  level %d: %d table pages, %d interior PTEs, %d %s leaves\n",
+               level, (int)st.tables[level], (int)st.interior[level],
+               (int)st.leaves[level], sizename[level]);
+    }
+    printf("  footprint %d KB, mapped %d KB\n",
+           (int)(ntables * PGSIZE / 1024), (int)(st.mapped / 1024));
+
+    printf("  perms:");
+    for (int i = 1; i < 8; i++)
+        if (st.perm[i])
+            printf(" %s %d", permname[i], (int)st.perm[i]);
+    printf("\n");
+
+    printf("  user %d, global %d, accessed %d, dirty %d, shared %d, swapped %d\n",
+           (int)st.user, (int)st.global, (int)st.accessed, (int)st.dirty,
+           (int)st.shared, (int)st.swapped);
+}
@@ -0,0 +1,24 @@
+#ifndef XV6_PTSTAT_H
+#define XV6_PTSTAT_H
+
+#include "types.h"
+
+#define PT_LEVELS 3 // Sv39 三级页表
+
+// 一棵页表的占用与映射统计，由 ptstat_collect() 填写
+// 下标为页表级别：2 为根，0 为最底层
+struct ptstat {
+    uint64 tables[PT_LEVELS]; // 各级页表页数
+    uint64 interior[PT_LEVELS]; // 各级指向下级页表的 PTE 数
+    uint64 leaves[PT_LEVELS]; // 各级叶子映射数：0 级 4K，1 级 2M，2 级 1G
+    uint64 perm[8];           // 叶子按 (X W R) 三位组合分类，下标为 (pte >> 1) & 7
+    uint64 user;              // PTE_U 叶子数
+    uint64 global;            // PTE_G 叶子数
+    uint64 accessed;          // PTE_A 叶子数
+    uint64 dirty;             // PTE_D 叶子数
+    uint64 shared;            // 共享代码页（PTE_SHARED）数
+    uint64 swapped;           // 已换出（PTE_SWAP）的 PTE 数
+    uint64 mapped;            // 叶子映射的总字节数
+};
+
+#endif // XV6_PTSTAT_H
@@ -0,0 +1,478 @@
+// 页面回收与交换。
+//
+// kalloc() 发现空闲链表耗尽时调用 reclaim()。回收器使用时钟（二次机会）算法
+// 扫描已登记用户地址空间中的叶子 PTE：PTE_A 置位的页面清除 A 位后放过，
+// 未被访问过的匿名页面写入 virtio 磁盘上的交换槽，然后释放物理页。
+//
+// 换出后的 PTE 清除 PTE_V、保留权限位并置 PTE_SWAP，PPN 字段改存交换槽号。
+// 再次访问时触发缺页，kerneltrap() 调用 swap_fault() 把页面读回。
+//
+// swap.lock 也是已登记地址空间的映射锁：回收器、swap_fault() 以及
+// 拆除或复制映射的 uvmunmap()、uvmcopy()（通过 swap_lock()）都在它之下修改 PTE。
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+#include "atomic.h"
+#include "swap.h"
+
+// 一个登记给回收器的用户地址空间，扫描范围为 [0, sz)
+struct swap_as
+{
+    pagetable_t pagetable;
+    uint64 sz;
+};
+
+static struct
+{
+    struct sleeplock lock; // 换入换出时持有它读写磁盘，等待者不空转
+    struct swap_as as[NSWAPAS];
+    int hand_as;    // 时钟指针：当前扫描的地址空间
+    uint64 hand_va; // 时钟指针：下一个要检查的虚拟地址
+    uint nslots;    // 交换区实际可用的槽数
+    uint8 slotmap[NSWAPSLOT / 8];
+    struct
+    {
+        uint64 pa;
+        int ref;
+    } pins[NSWAPPIN]; // 被 swap_pin() 钉住的页面
+    struct swapstat stat;
+} swap;
+
+void swapinit(void)
+{
+    uint64 n;
+
+    initsleeplock(&swap.lock, "swap");
+
+    n = virtio_disk_size() / PGSIZE;
+    swap.nslots = n > NSWAPSLOT ? NSWAPSLOT : n;
+    if (swap.nslots)
+        printf("swap: %d slots on virtio disk\n", swap.nslots);
+}
+
+// 分配一个交换槽，失败返回 -1
+// 调用者持有 swap.lock
+static int
+slot_alloc(void)
+{
+    for (int i = 0; i < swap.nslots; i++)
+    {
+        if ((swap.slotmap[i / 8] & (1 << (i % 8))) == 0)
+        {
+            swap.slotmap[i / 8] |= (1 << (i % 8));
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void
+slot_free(uint slot)
+{
+    if (slot >= swap.nslots || (swap.slotmap[slot / 8] & (1 << (slot % 8))) == 0)
+        panic("slot_free");
+    swap.slotmap[slot / 8] &= ~(1 << (slot % 8));
+}
+
+// 交换槽在磁盘上的字节偏移
+static inline uint64
+slot_offset(uint slot)
+{
+    return (uint64)slot * PGSIZE;
+}
+
+// 登记一个用户地址空间，使其匿名页面可以被换出
+// 已登记的页表只更新大小。成功返回 0，表满返回 -1
+int swap_register(pagetable_t pagetable, uint64 sz)
+{
+    struct swap_as *free = 0;
+
+    acquiresleep(&swap.lock);
+    for (struct swap_as *as = swap.as; as < &swap.as[NSWAPAS]; as++)
+    {
+        if (as->pagetable == pagetable)
+        {
+            as->sz = sz;
+            releasesleep(&swap.lock);
+            return 0;
+        }
+        if (as->pagetable == 0 && free == 0)
+            free = as;
+    }
+    if (free)
+    {
+        free->pagetable = pagetable;
+        free->sz = sz;
+    }
+    releasesleep(&swap.lock);
+    return free ? 0 : -1;
+}
+
+// 已登记的地址空间，没有登记时返回 0
+// 调用者持有 swap.lock
+static struct swap_as *
+as_lookup(pagetable_t pagetable)
+{
+    for (struct swap_as *as = swap.as; as < &swap.as[NSWAPAS]; as++)
+        if (as->pagetable == pagetable)
+            return as;
+    return 0;
+}
+
+// 在释放页表之前注销地址空间
+void swap_unregister(pagetable_t pagetable)
+{
+    acquiresleep(&swap.lock);
+    for (struct swap_as *as = swap.as; as < &swap.as[NSWAPAS]; as++)
+    {
+        if (as->pagetable == pagetable)
+        {
+            as->pagetable = 0;
+            as->sz = 0;
+        }
+    }
+    releasesleep(&swap.lock);
+}
+
+// 修改用户页表的映射之前获取，与回收器和 swap_fault() 互斥：
+// 否则回收器可能把正在拆除或复制的页面换出并释放
+void swap_lock(void)
+{
+    acquiresleep(&swap.lock);
+}
+
+void swap_unlock(void)
+{
+    releasesleep(&swap.lock);
+}
+
+// 拆除映射时释放已换出 PTE 占用的交换槽
+// 不是换出 PTE 时什么也不做。调用者通过 swap_lock() 持有 swap.lock
+void swap_discard(pte_t *pte)
+{
+    if ((*pte & PTE_V) || (*pte & PTE_SWAP) == 0)
+        return;
+    if (!holdingsleep(&swap.lock))
+        panic("swap_discard");
+    slot_free(PTE2SLOT(*pte));
+    *pte = 0;
+}
+
+// 推进时钟指针，返回下一个被检查页面的 PTE（可能为 0）
+// 没有可扫描的地址空间时返回 0 且 *done 置 1
+static pte_t *
+clock_next(int *done)
+{
+    struct swap_as *as = &swap.as[swap.hand_as];
+
+    if (as->pagetable == 0 || swap.hand_va >= as->sz)
+    {
+        // 当前地址空间扫完，转到下一个已登记的地址空间
+        int i;
+        for (i = 1; i <= NSWAPAS; i++)
+        {
+            as = &swap.as[(swap.hand_as + i) % NSWAPAS];
+            if (as->pagetable && as->sz > 0)
+                break;
+        }
+        if (i > NSWAPAS)
+        {
+            *done = 1;
+            return 0;
+        }
+        swap.hand_as = as - swap.as;
+        swap.hand_va = 0;
+    }
+
+    uint64 va = swap.hand_va;
+    swap.hand_va += PGSIZE;
+    return walk(as->pagetable, va, 0);
+}
+
+// 页面是否被钉住
+// 调用者持有 swap.lock
+static int
+is_pinned(uint64 pa)
+{
+    for (int i = 0; i < NSWAPPIN; i++)
+        if (swap.pins[i].ref && swap.pins[i].pa == pa)
+            return 1;
+    return 0;
+}
+
+// 是否为可以换出的匿名用户页面
+static inline int
+is_evictable(pte_t pte)
+{
+    // 共享代码页属于代码页缓存，不按匿名页换出
+    return (pte & PTE_V) && (pte & PTE_U) && (pte & (PTE_R | PTE_W | PTE_X)) &&
+           (pte & PTE_SHARED) == 0 && !is_pinned(PTE2PA(pte));
+}
+
+// 把 pte 指向的页面写入交换区并释放物理页
+// 调用者持有 swap.lock
+static int
+evict(pte_t *pte)
+{
+    pte_t old = *pte;
+    uint64 pa = PTE2PA(old);
+    int slot;
+
+    if ((slot = slot_alloc()) < 0)
+        return -1;
+
+    // 先让映射失效，并等所有 CPU 刷新 TLB，避免写盘期间页面继续被修改
+    *pte = SLOT2PTE(slot) | (PTE_FLAGS(old) & ~(PTE_V | PTE_A | PTE_D)) | PTE_SWAP;
+    sfence_vma_all();
+
+    if (virtio_disk_rw(slot_offset(slot), (void *)pa, 1) != 0)
+    {
+        *pte = old;
+        slot_free(slot);
+        return -1;
+    }
+
+    kfree((void *)pa);
+    return 0;
+}
+
+// 回收最多 npages 个物理页，返回实际回收的页数
+// 由 kalloc() 在空闲链表耗尽时调用，调用时不能持有 kmem.lock
+int reclaim(int npages)
+{
+    int freed = 0, done = 0;
+    uint64 budget = 0;
+    pte_t *pte;
+
+    if (swap.nslots == 0)
+        return 0;
+
+    // 调用者在 swap_lock() 之内分配内存（uvmcopy()），不能再获取 swap.lock
+    if (holdingsleep(&swap.lock))
+        return 0;
+
+    // 换出要等其他 CPU 确认刷新了 TLB（见 sfence_vma_all()）。
+    // 持有 spinlock 时不能等，放弃回收
+    push_off();
+    if (mycpu()->noff > 1)
+    {
+        pop_off();
+        return 0;
+    }
+    pop_off();
+
+    acquiresleep(&swap.lock);
+
+    // 最多转两圈：第一圈清掉 A 位，第二圈一定能遇到冷页面
+    for (struct swap_as *as = swap.as; as < &swap.as[NSWAPAS]; as++)
+        if (as->pagetable)
+            budget += 2 * (PGROUNDUP(as->sz) / PGSIZE);
+
+    while (freed < npages && budget-- > 0)
+    {
+        pte = clock_next(&done);
+        if (done)
+            break;
+        if (pte == 0 || !is_evictable(*pte))
+            continue;
+
+        swap.stat.scanned++;
+        if (*pte & PTE_A)
+        {
+            // 最近被访问过，给二次机会
+            // 原子地清除：支持 Svadu 的硬件可能同时在置 D 位
+            atomic64_fetch_and(pte, ~PTE_A);
+            swap.stat.referenced++;
+            continue;
+        }
+
+        if (evict(pte) == 0)
+        {
+            swap.stat.evictions++;
+            freed++;
+        }
+        else
+        {
+            swap.stat.failed++;
+            break;
+        }
+    }
+
+    releasesleep(&swap.lock);
+
+    // 让清除的 A 位对本 CPU 的 TLB 生效
+    sfence_vma();
+    return freed;
+}
+
+// 处理地址空间 pagetable 中访问 va 引起的缺页
+// 页面已换出时读回交换区内容；对不自动维护 A/D 位的硬件补上 A/D 位
+// 只处理登记过的地址空间，其他页表中不会有换出的页面。
+// 处理成功返回 0，不是本模块负责的缺页返回 -1
+int swap_fault(pagetable_t pagetable, uint64 va, int write)
+{
+    pte_t *pte;
+    char *mem = 0;
+    uint slot;
+    int r = -1;
+
+    if (va >= MAXVA)
+        return -1;
+
+    va = PGROUNDDOWN(va);
+
+again:
+    acquiresleep(&swap.lock);
+    if (as_lookup(pagetable) == 0 || (pte = walk(pagetable, va, 0)) == 0)
+        goto out;
+
+    if (*pte & PTE_V)
+    {
+        if (mem)
+        {
+            // 分配内存期间其他 CPU 已经换入了这个页面，重新执行访问
+            r = 0;
+            goto out;
+        }
+        // Svade: 硬件要求软件设置 A/D 位
+        if (!(*pte & PTE_U) || (write && !(*pte & PTE_W)))
+            goto out;
+        if ((*pte & PTE_A) && (!write || (*pte & PTE_D)))
+            goto out;
+        *pte |= PTE_A | (write ? PTE_D : 0);
+        r = 0;
+        goto out;
+    }
+
+    if ((*pte & PTE_SWAP) == 0)
+        goto out;
+
+    if (mem == 0)
+    {
+        // kalloc() 可能进入 reclaim() 获取 swap.lock：放开锁分配，回来重新检查
+        releasesleep(&swap.lock);
+        if ((mem = kalloc()) == 0)
+            return -1;
+        goto again;
+    }
+
+    slot = PTE2SLOT(*pte);
+    if (virtio_disk_rw(slot_offset(slot), mem, 0) != 0)
+        panic("swap_fault: read");
+
+    *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_V | PTE_A | (write ? PTE_D : 0);
+    slot_free(slot);
+    swap.stat.majfaults++;
+    mem = 0;
+    r = 0;
+
+out:
+    releasesleep(&swap.lock);
+    if (mem)
+        kfree(mem);
+    if (r == 0)
+        sfence_vma();
+    return r;
+}
+
+// 换入 pagetable 中 va 所在的页面并把它钉住，页面的物理地址写入 *pap，
+// 在 swap_unpin() 之前回收器不会换出它，物理地址保持不变。
+// 钉住页面的只有等待中的 CPU，表按 NCPU 分配，每个 CPU 同时只钉一页时不会满。
+// 成功返回 0，地址无效返回 -1，钉住的页面太多返回 -2
+int swap_pin(pagetable_t pagetable, uint64 va, uint64 *pap)
+{
+    uint64 pa;
+    int i, free;
+
+    va = PGROUNDDOWN(va);
+    for (;;)
+    {
+        acquiresleep(&swap.lock);
+        if ((pa = walkaddr(pagetable, va)) != 0)
+            break;
+        releasesleep(&swap.lock);
+        // 换入之后、重新获取锁之前页面可能又被换出，再试一次
+        if (swap_fault(pagetable, va, 0) != 0)
+            return -1;
+    }
+
+    free = -1;
+    for (i = 0; i < NSWAPPIN; i++)
+    {
+        if (swap.pins[i].ref && swap.pins[i].pa == pa)
+            break;
+        if (swap.pins[i].ref == 0 && free < 0)
+            free = i;
+    }
+    if (i == NSWAPPIN)
+    {
+        if (free < 0)
+        {
+            releasesleep(&swap.lock);
+            return -2;
+        }
+        i = free;
+        swap.pins[i].pa = pa;
+    }
+    swap.pins[i].ref++;
+    releasesleep(&swap.lock);
+    *pap = pa;
+    return 0;
+}
+
+// 解除 swap_pin() 对 pa 所在页面的钉住
+void swap_unpin(uint64 pa)
+{
+    int i;
+
+    pa = PGROUNDDOWN(pa);
+    acquiresleep(&swap.lock);
+    for (i = 0; i < NSWAPPIN; i++)
+        if (swap.pins[i].ref && swap.pins[i].pa == pa)
+            break;
+    if (i == NSWAPPIN)
+        panic("swap_unpin");
+    swap.pins[i].ref--;
+    releasesleep(&swap.lock);
+}
+
+// 复制一份回收统计
+void swapstat(struct swapstat *st)
+{
+    acquiresleep(&swap.lock);
+    *st = swap.stat;
+    releasesleep(&swap.lock);
+}
+
+// 在控制台打印回收统计
+// 扫描速率按上一次打印以来的增量计算，能看出一次回收高峰期间的速率
+void swapstat_print(void)
+{
+    static uint64 last_scanned; // 上一次打印时的快照，由 swap.lock 保护
+    static uint last_ticks;
+    struct swapstat st;
+    uint64 dscan;
+    uint t, dt;
+
+    acquiresleep(&swap.lock);
+    st = swap.stat;
+    t = readticks();
+    dscan = st.scanned - last_scanned;
+    dt = t - last_ticks;
+    last_scanned = st.scanned;
+    last_ticks = t;
+    releasesleep(&swap.lock);
+
+    if (dt == 0)
+        dt = 1;
+    printf("swap: slots %d, scanned %d (%d/tick over last %d ticks), referenced %d\n",
+           swap.nslots, (int)st.scanned, (int)(dscan / dt), (int)dt, (int)st.referenced);
+    printf("swap: evictions %d, major faults %d, failed %d\n",
+           (int)st.evictions, (int)st.majfaults, (int)st.failed);
+}
@@ -0,0 +1,15 @@
+#ifndef XV6_SWAP_H
+#define XV6_SWAP_H
+
+#include "types.h"
+
+// 页面回收统计，由 swapstat() 导出
+struct swapstat {
+    uint64 scanned;    // 时钟指针扫过的用户页面数
+    uint64 referenced; // 因 PTE_A 置位而获得二次机会的页面数
+    uint64 evictions;  // 换出到交换区的页面数
+    uint64 majfaults;  // 从交换区换入的缺页次数
+    uint64 failed;     // 交换槽耗尽或磁盘出错导致的换出失败次数
+};
+
+#endif // XV6_SWAP_H
@@ -0,0 +1,240 @@
+// 共享代码页缓存。
+//
+// 运行同一程序的多个进程共享其代码段和只读数据段的物理页。
+// 缓存以 (dev, inum, off) 为键，即可执行文件 inode 中页对齐的偏移；
+// 命中时只增加引用计数并建立只读映射，不再复制页面内容。
+// 这些 PTE 带有 PTE_SHARED 标记，uvmunmap() 通过 textpage_put()
+// 归还引用，最后一个引用消失时释放物理页。
+// 表项另按物理地址散列，textpage_put() 不用扫描整个表；
+// 空闲表项串在 free 链表上。
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NTEXTHASH 64
+
+struct textpage
+{
+    uint dev;              // 可执行文件所在设备
+    uint inum;             // 可执行文件 inode 号
+    uint64 off;            // 页在文件中的偏移，页对齐
+    uint64 pa;             // 缓存的物理页，0 表示表项空闲
+    int ref;               // 映射该页的 PTE 数
+    int cached;            // 是否仍可被 (dev, inum, off) 查到
+    struct textpage *next; // 同一键散列桶中的下一项
+    struct textpage *panext; // 同一物理地址散列桶中的下一项；空闲时为 free 链表
+};
+
+static struct
+{
+    struct spinlock lock;
+    struct textpage pages[NTEXTPAGE];
+    struct textpage *hash[NTEXTHASH];   // 按 (dev, inum, off) 散列
+    struct textpage *pahash[NTEXTHASH]; // 按 pa 散列，包括已不可查到的页
+    struct textpage *free;              // pa == 0 的表项
+} textcache;
+
+void textcache_init(void)
+{
+    initlock(&textcache.lock, "textcache");
+    for (int i = NTEXTPAGE - 1; i >= 0; i--)
+    {
+        textcache.pages[i].panext = textcache.free;
+        textcache.free = &textcache.pages[i];
+    }
+}
+
+static inline uint
+text_hash(uint dev, uint inum, uint64 off)
+{
+    return (dev * 31 + inum * 17 + (off >> PGSHIFT)) % NTEXTHASH;
+}
+
+static inline uint
+pa_hash(uint64 pa)
+{
+    return (pa >> PGSHIFT) % NTEXTHASH;
+}
+
+// 调用者持有 textcache.lock
+static struct textpage *
+text_lookup(uint dev, uint inum, uint64 off)
+{
+    struct textpage *tp;
+
+    for (tp = textcache.hash[text_hash(dev, inum, off)]; tp; tp = tp->next)
+        if (tp->dev == dev && tp->inum == inum && tp->off == off)
+            return tp;
+    return 0;
+}
+
+// 从散列桶中摘除，之后新的查找不会再命中该页
+// 调用者持有 textcache.lock
+static void
+text_unhash(struct textpage *tp)
+{
+    struct textpage **pp;
+
+    for (pp = &textcache.hash[text_hash(tp->dev, tp->inum, tp->off)]; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == tp)
+        {
+            *pp = tp->next;
+            break;
+        }
+    }
+    tp->next = 0;
+    tp->cached = 0;
+}
+
+// 查找并引用 (dev, inum, off) 对应的缓存页
+// 命中返回物理地址，未命中返回 0
+uint64
+textpage_get(uint dev, uint inum, uint64 off)
+{
+    struct textpage *tp;
+    uint64 pa = 0;
+
+    acquire(&textcache.lock);
+    if ((tp = text_lookup(dev, inum, off)) != 0)
+    {
+        tp->ref++;
+        pa = tp->pa;
+    }
+    release(&textcache.lock);
+    return pa;
+}
+
+// 把已填好内容的物理页 pa 加入缓存，引用计数为 1
+// 若其他进程抢先加入了同一页，返回已缓存的页（调用者应释放自己的 pa）
+// 缓存已满时返回 0，调用者退回私有映射
+uint64
+textpage_add(uint dev, uint inum, uint64 off, uint64 pa)
+{
+    struct textpage *tp, *free = 0;
+    uint h;
+
+    acquire(&textcache.lock);
+    if ((tp = text_lookup(dev, inum, off)) != 0)
+    {
+        tp->ref++;
+        pa = tp->pa;
+        release(&textcache.lock);
+        return pa;
+    }
+
+    if ((free = textcache.free) == 0)
+    {
+        release(&textcache.lock);
+        return 0;
+    }
+    textcache.free = free->panext;
+
+    free->dev = dev;
+    free->inum = inum;
+    free->off = off;
+    free->pa = pa;
+    free->ref = 1;
+    free->cached = 1;
+    h = text_hash(dev, inum, off);
+    free->next = textcache.hash[h];
+    textcache.hash[h] = free;
+    h = pa_hash(pa);
+    free->panext = textcache.pahash[h];
+    textcache.pahash[h] = free;
+    release(&textcache.lock);
+    return pa;
+}
+
+// 归还对共享页 pa 的一个引用，最后一个引用释放物理页
+void textpage_put(uint64 pa)
+{
+    struct textpage *tp, **pp;
+
+    acquire(&textcache.lock);
+    for (pp = &textcache.pahash[pa_hash(pa)]; (tp = *pp) != 0; pp = &tp->panext)
+        if (tp->pa == pa)
+            break;
+    if (tp == 0 || tp->ref < 1)
+        panic("textpage_put");
+
+    if (--tp->ref > 0)
+    {
+        release(&textcache.lock);
+        return;
+    }
+
+    if (tp->cached)
+        text_unhash(tp);
+    *pp = tp->panext;
+    tp->pa = 0;
+    tp->panext = textcache.free;
+    textcache.free = tp;
+    release(&textcache.lock);
+
+    kfree((void *)pa);
+}
+
+// 可执行文件内容被修改或 inode 被回收时调用
+// 已有映射继续使用旧页，新的查找不再命中
+void textcache_invalidate(uint dev, uint inum)
+{
+    struct textpage *tp;
+
+    acquire(&textcache.lock);
+    for (tp = textcache.pages; tp < &textcache.pages[NTEXTPAGE]; tp++)
+        if (tp->pa && tp->cached && tp->dev == dev && tp->inum == inum)
+            text_unhash(tp);
+    release(&textcache.lock);
+}
+
+// 把可执行文件 (dev, inum) 偏移 off 处的一页以只读共享方式映射到 va
+// 缓存未命中时分配新页，由 fill(arg, mem, off) 读入页面内容（成功返回 0）
+// perm 中的 PTE_W 会被去掉。成功返回 0，失败返回 -1
+int textmap(pagetable_t pagetable, uint64 va, uint dev, uint inum, uint64 off, int perm,
+            int (*fill)(void *, char *, uint64), void *arg)
+{
+    uint64 pa, cached;
+    char *mem;
+
+    if ((va % PGSIZE) != 0 || (off % PGSIZE) != 0)
+        panic("textmap: not aligned");
+
+    if ((pa = textpage_get(dev, inum, off)) == 0)
+    {
+        if ((mem = kalloc()) == 0)
+            return -1;
+        page_zero(mem);
+        if (fill(arg, mem, off) != 0)
+        {
+            kfree(mem);
+            return -1;
+        }
+
+        cached = textpage_add(dev, inum, off, (uint64)mem);
+        if (cached == 0)
+        {
+            // 缓存已满，退回私有只读映射
+            if (mappages(pagetable, va, PGSIZE, (uint64)mem, (perm & ~PTE_W) | PTE_U) != 0)
+            {
+                kfree(mem);
+                return -1;
+            }
+            return 0;
+        }
+        if (cached != (uint64)mem)
+            kfree(mem); // 其他进程先把同一页放进了缓存
+        pa = cached;
+    }
+
+    if (mappages(pagetable, va, PGSIZE, pa, (perm & ~PTE_W) | PTE_U | PTE_SHARED) != 0)
+    {
+        textpage_put(pa);
+        return -1;
+    }
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "static_key.h"
 
 /*
  * 内核页表
@@ -22,7 +23,7 @@ kvmmake(void)
 
     kpgtbl = (pagetable_t)kalloc();
     // 原来可能是垃圾值, 先清理
-    memset(kpgtbl, 0, PGSIZE);
+    page_zero(kpgtbl);
 
     // Test device for shutdown control
     //   kvmmap(kpgtbl, TEST_DEVICE, TEST_DEVICE, PGSIZE, PTE_R | PTE_W);
@@ -30,12 +31,15 @@ kvmmake(void)
     // uart寄存器
     kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
-    //   // virtio mmio磁盘接口
-    //   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+    // virtio mmio磁盘接口（交换区）
+    kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
     // PLIC
     kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+    // CLINT：S 模式写 MSIP 发送 IPI
+    kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
     // 映射内核代码段为可执行和只读
     kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext - KERNBASE, PTE_R | PTE_X);
 
@@ -132,7 +136,7 @@ allocate_page_table_page(void)
     pagetable_t new_table = (pagetable_t)kalloc();
     if (new_table == 0)
         return 0;
-    memset(new_table, 0, PGSIZE);
+    page_zero(new_table);
     return new_table;
 }
 
@@ -150,17 +154,16 @@ allocate_page_table_page(void)
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
-    static int print_once = 0;
     if (va >= MAXVA)
         panic("walk: virtual address too large");
 
-    #ifdef PAGE_TABLE_DEBUG
-    if (va == TRAMPOLINE)
+    // 跟踪 TRAMPOLINE 的页表遍历过程，由 walk_debug 控制，
+    // 关闭时只有一条 nop，不再比较每个 va
+    int debug = static_key_false(&walk_debug) && va == TRAMPOLINE;
+    if (debug)
     {
-        printf("[debug]: walk: va %p\n", va, cpuid());
+        printf("[debug]: walk: va %p\n", va);
     }
-    #endif
-
 
     // 遍历页表层级，从顶级(level 2)到中间级(level 1)
     // 最后返回叶子级(level 0)的PTE地址
@@ -169,16 +172,12 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
         uint64 index = extract_page_table_index(va, level);
         // 获取对应 PTE 表项
         pte_t *pte = &pagetable[index];
-        #ifdef PAGE_TABLE_DEBUG
-        if (va == TRAMPOLINE)
+        if (debug)
             printf("[debug]: walk: level %d, index %d, pte %p ", level, index, *pte);
-        #endif
         if (is_pte_valid(*pte))
         {
-            #ifdef PAGE_TABLE_DEBUG
-            if (va == TRAMPOLINE)
+            if (debug)
                 printf("(valid)\n");
-            #endif
             // PTE有效，获取下一级页表的物理地址
             uint64 next_pa = get_next_page_table_pa(*pte);
             pagetable = (pagetable_t)next_pa;
@@ -200,18 +199,16 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
             // 在当前PTE中设置新页表的地址
             // 权限位全 0
             *pte = create_page_table_pte((uint64)new_table);
-            #ifdef PAGE_TABLE_DEBUG
-            if(va == TRAMPOLINE)
+            if (debug)
                 printf("(new page table allocated at %p)\n", new_table);
-            #endif
             pagetable = new_table;
         }
     }
 
     // 返回叶子级(level 0)的PTE地址
     uint64 leaf_index = extract_page_table_index(va, 0);
-    if (va == TRAMPOLINE){
-        print_once += 1;
+    if (debug)
+    {
         pte_t leaf = pagetable[leaf_index];
         printf("[debug]: walk: level 0, index %d, pte %p\n", leaf_index, leaf);
         if (is_pte_valid(leaf) && is_pte_leaf(leaf)) {
@@ -344,35 +341,50 @@ validate_page_mapping(pte_t pte)
         panic("uvmunmap: not a leaf page");
 }
 
-// // 从va开始移除npages个映射。va必须是
-// // 页面对齐的。映射必须存在。
-// // 可选择释放物理内存
-// void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
-// {
-//     uint64 current_va;
-//     pte_t *pte;
+// 从va开始移除npages个映射。va必须是
+// 页面对齐的。映射必须存在。
+// 可选择释放物理内存：共享代码页归还给代码页缓存，
+// 已换出的页面释放其交换槽
+void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+{
+    uint64 current_va;
+    pte_t *pte;
 
-//     if (!is_page_aligned(va))
-//         panic("uvmunmap: address not page aligned");
+    if (!is_page_aligned(va))
+        panic("uvmunmap: address not page aligned");
 
+    // 拆除期间回收器不能换出这些页面
+    swap_lock();
 
-//     // 找到物理地址并 kfree
-//     for (current_va = va; current_va < va + npages * PGSIZE; current_va += PGSIZE)
-//     {
-//         pte = walk(pagetable, current_va, 0);
-//         if (pte == 0)
-//             panic("uvmunmap: walk failed");
+    // 找到物理地址并 kfree
+    for (current_va = va; current_va < va + npages * PGSIZE; current_va += PGSIZE)
+    {
+        pte = walk(pagetable, current_va, 0);
+        if (pte == 0)
+            panic("uvmunmap: walk failed");
 
-//         validate_page_mapping(*pte);
+        if (!is_pte_valid(*pte) && (*pte & PTE_SWAP))
+        {
+            swap_discard(pte);
+            continue;
+        }
 
-//         if (do_free)
-//         {
-//             free_physical_page_from_pte(*pte);
-//         }
+        validate_page_mapping(*pte);
 
-//         clear_pte(pte);
-//     }
-// }
+        if (*pte & PTE_SHARED)
+        {
+            // 共享页不属于这个地址空间，无论 do_free 都只归还引用
+            textpage_put(PTE2PA(*pte));
+        }
+        else if (do_free)
+        {
+            free_physical_page_from_pte(*pte);
+        }
+
+        clear_pte(pte);
+    }
+    swap_unlock();
+}
 
 // // 创建一个空的用户页表
 // // 如果内存不足则返回0
@@ -586,6 +598,8 @@ validate_page_mapping(pte_t pte)
 //     uint flags;
 //     char *mem;
 
+//     // 复制期间回收器不能换出 old 的页面（锁内分配内存时 reclaim() 直接放弃）
+//     swap_lock();
 //     for (current_va = 0; current_va < sz; current_va += PGSIZE)
 //     {
 //         pte = walk(old, current_va, 0);
@@ -607,9 +621,11 @@ validate_page_mapping(pte_t pte)
 //             goto err;
 //         }
 //     }
+//     swap_unlock();
 //     return 0;
 
 // err:
+//     swap_unlock();
 //     cleanup_partial_copy(new, current_va);
 //     return -1;
 // }
@@ -1 +1,14 @@
-#define NCPU 8
\ No newline at end of file
+#define NCPU 8
+#define TICK_INTERVAL 1000000 // 时钟节拍间隔（mtime 周期，10MHz 下为 0.1 秒）
+#define NHRTIMER     64  // 每个 CPU 同时排队的高精度定时器数
+#define PRINTBUF_SIZE 256 // 每个 CPU 的 printf 格式化缓冲区大小
+#define NMCS          4   // 每个 CPU 可同时持有的 MCS 锁数
+#define NSWAPAS      16  // 回收器最多跟踪的用户地址空间数
+#define NSWAPSLOT  8192  // 交换槽上限（每槽一页，共 32MB）
+#define NSWAPPIN   NCPU  // 同时被钉住的页面数：每个等待 futex 的 CPU 最多钉住一页
+#define RECLAIM_BATCH 32 // kalloc 失败时一次回收的页数
+#define NTEXTPAGE   512  // 共享代码页缓存的容量（页）
+#define UARTRXTRIG    8  // uart 接收 FIFO 触发深度：1、4、8 或 14 字节
+#define INPUT_BUF_SIZE 1024 // 控制台输入缓冲区大小
+#define NKLOG        64  // 每个 CPU 日志环的记录数（每条 128 字节）
+#define NTRACEBUF   256  // 每个 CPU 的 trace 事件数（每个 32 字节）
@@ -0,0 +1,40 @@
+#ifndef XV6_PERCPU_H
+#define XV6_PERCPU_H
+
+#include "types.h"
+#include "riscv.h"
+
+// Per-CPU data areas.
+//
+// 用 DEFINE_PER_CPU 定义的变量放在 .bss.percpu 段。
+// kernel.ld 把这个段按缓存行对齐，并在其后为每个 CPU 复制一份，
+// 第 i 个 CPU 的副本位于 &var + i * PERCPU_STRIDE。
+// 因为整个区域和步长都按 CACHELINE 对齐，不同 CPU 的数据不会落在同一缓存行。
+// 当前 CPU 的编号取自 tp（见 cpuid()）。
+//
+// this_cpu_* 访问的是当前 CPU 的副本，调用者应关中断，
+// 或者能容忍在访问期间被中断（例如只做统计的计数器）。
+
+extern char __percpu_start[], __percpu_end[], __percpu_ncpu[];
+
+// 每个 CPU 副本之间的距离
+#define PERCPU_STRIDE ((uint64)(__percpu_end - __percpu_start))
+// kernel.ld 预留的副本数，必须等于 NCPU
+#define PERCPU_NCPU   ((uint64)__percpu_ncpu)
+
+#define DEFINE_PER_CPU(type, name) \
+  __attribute__((section(".bss.percpu"))) type name
+#define DECLARE_PER_CPU(type, name) \
+  extern __attribute__((section(".bss.percpu"))) type name
+
+#define per_cpu_ptr(var, cpu) \
+  ((__typeof__(&(var)))((char *)&(var) + (uint64)(cpu) * PERCPU_STRIDE))
+#define per_cpu(var, cpu)     (*per_cpu_ptr(var, cpu))
+
+#define this_cpu_ptr(var)     per_cpu_ptr(var, r_tp())
+#define this_cpu_read(var)    (*this_cpu_ptr(var))
+#define this_cpu_write(var, v) (*this_cpu_ptr(var) = (v))
+#define this_cpu_add(var, v)  (*this_cpu_ptr(var) += (v))
+#define this_cpu_inc(var)     this_cpu_add(var, 1)
+
+#endif // XV6_PERCPU_H
@@ -2,7 +2,9 @@
 #include "proc.h"
 #include "param.h"
 
-struct cpu cpus[NCPU];
+// 每个 CPU 的 struct cpu 在各自的 per-CPU 区域中，
+// 相邻 CPU 的 noff/intena 不再共享缓存行
+DEFINE_PER_CPU(struct cpu, cpu_data);
 // 需要关中断，以防止内核切换过程中的险态
 int
 cpuid()
@@ -13,7 +15,5 @@ cpuid()
 
 struct cpu* mycpu(){
 
-  int my_id = cpuid();
-
-  return &cpus[my_id];
-}
\ No newline at end of file
+  return this_cpu_ptr(cpu_data);
+}
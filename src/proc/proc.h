@@ -1,5 +1,7 @@
 #include "param.h"
 #include "types.h"
+#include "spinlock.h"
+#include "percpu.h"
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -25,9 +27,11 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  char printbuf[PRINTBUF_SIZE]; // printf() 的格式化缓冲区
+  struct mcs_node mcs[NMCS];  // 本 CPU 等待 / 持有 MCS 锁时使用的队列节点
 };
 
-extern struct cpu cpus[NCPU];
+DECLARE_PER_CPU(struct cpu, cpu_data);
 
 
 int cpuid();
@@ -36,6 +36,18 @@ w_mstatus(uint64 x)
   asm volatile("csrw mstatus, %0" : : "r" (x));
 }
 
+// Machine ISA Register, misa
+// 低 26 位每位对应一个单字母扩展
+#define MISA_EXT(c) (1L << ((c) - 'A'))
+
+static inline uint64
+r_misa()
+{
+  uint64 x;
+  asm volatile("csrr %0, misa" : "=r" (x) );
+  return x;
+}
+
 // machine exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -47,6 +59,8 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_VS (3L << 9)   // Vector state: 0=Off, 1=Initial, 2=Clean, 3=Dirty
+#define SSTATUS_VS_INITIAL (1L << 9)
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -206,6 +220,8 @@ w_pmpaddr0(uint64 x)
 #define SATP_SV39 (8L << 60)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+// 从 satp 取回根页表的物理地址（PPN 占低 44 位）
+#define SATP2PGTBL(satp) ((pagetable_t)(((satp) & ((1L << 44) - 1)) << 12))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -223,6 +239,52 @@ r_satp()
   return x;
 }
 
+// Machine Environment Configuration (特权级规范 1.12)
+// 用 CSR 编号访问，旧工具链不认识 menvcfg 这个名字
+#define ENVCFG_CBZE (1L << 7) // 允许低特权级执行 cbo.zero
+#define ENVCFG_STCE (1L << 63) // Sstc: 允许 S 模式使用 stimecmp
+
+static inline uint64
+r_menvcfg()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0x30a" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_menvcfg(uint64 x)
+{
+  asm volatile("csrw 0x30a, %0" : : "r" (x));
+}
+
+// Zicboz: cbo.zero 把 p 所在的整个缓存块清零
+// 缓存块大小应来自设备树 (riscv,cboz-block-size)，这里使用 qemu 的默认值
+#define CBOZ_BLOCK_SIZE 64
+
+static inline void
+cbo_zero(void *p)
+{
+  asm volatile(".insn i 0x0f, 2, x0, %0, 4" : : "r" (p) : "memory");
+}
+
+// Sstc: Supervisor Timer Compare (CSR 0x14d)
+// time >= stimecmp 时 sip.STIP 置位，S 模式可以直接设定下一次时钟中断
+#define SIP_STIP (1L << 5)
+static inline uint64
+r_stimecmp()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0x14d" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_stimecmp(uint64 x)
+{
+  asm volatile("csrw 0x14d, %0" : : "r" (x));
+}
+
 // mscratch 暂时存放一个字大小的数据
 static inline void 
 w_mscratch(uint64 x)
@@ -249,6 +311,8 @@ r_stval()
 }
 
 // Machine-mode Counter-Enable
+#define MCOUNTEREN_CY (1L << 0) // S 模式可读 cycle
+#define MCOUNTEREN_TM (1L << 1) // S 模式可读 time
 static inline void 
 w_mcounteren(uint64 x)
 {
@@ -303,7 +367,7 @@ r_sp()
 }
 
 // read and write tp, the thread pointer, which xv6 uses to hold
-// this core's hartid (core number), the index into cpus[].
+// this core's hartid (core number), the index of its per-CPU area.
 static inline uint64
 r_tp()
 {
@@ -334,6 +398,22 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// 让本 CPU 之后取到的指令看到之前对代码的修改
+static inline void
+fence_i(void)
+{
+  asm volatile("fence.i" ::: "memory");
+}
+
+// 自旋等待循环中的提示：Zihintpause 的 pause 指令。
+// 它编码为 pred=W、succ=0 的 fence，属于 HINT 空间，
+// 不支持 Zihintpause 的处理器把它当作普通 fence 执行，因此无需探测。
+static inline void
+cpu_relax(void)
+{
+  asm volatile(".insn i 0x0f, 0, x0, x0, 0x010" ::: "memory");
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -348,6 +428,7 @@ typedef uint64 *pagetable_t; // 512 PTEs
 // 其余 44 位存放物理页框号 (PPN)
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
+#define CACHELINE 64 // 缓存行大小，各 CPU 分别写的数据按它对齐以免伪共享
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
@@ -360,6 +441,13 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_G (1 << 5) // global
 #define PTE_A (1 << 6) // accessed
 #define PTE_D (1 << 7) // dirty
+// 软件保留位 (RSW)，硬件忽略
+#define PTE_SWAP (1L << 8) // V=0 时表示页面已换出，PPN 字段存放交换槽号
+#define PTE_SHARED (1L << 9) // 页面属于共享代码缓存，解除映射时归还缓存而非 kfree
+
+// 换出页面的 PTE 中，交换槽号占用原 PPN 字段
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte) ((pte) >> 10)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,134 @@
+#ifndef XV6_ATOMIC_H
+#define XV6_ATOMIC_H
+
+#include "types.h"
+
+// Atomic operations built directly on RISC-V AMOs and LR/SC.
+//
+// 每个操作有四种内存序，用函数名后缀区分：
+//   _relaxed  只保证原子性                       amoXXX
+//   _acquire  之后的访存不会提前到它之前         amoXXX.aq
+//   _release  之前的访存不会推迟到它之后         amoXXX.rl
+//   （无后缀）顺序一致                           amoXXX.aqrl
+// 与 __sync_* 不同，这里不会额外生成完整的 fence。
+//
+// atomic_*   操作 32 位的 uint（.w 指令）
+// atomic64_* 操作 64 位的 uint64（.d 指令），也用于指针
+
+// 内存屏障
+#define smp_mb()  asm volatile("fence rw, rw" ::: "memory")
+#define smp_rmb() asm volatile("fence r, r" ::: "memory")
+#define smp_wmb() asm volatile("fence w, w" ::: "memory")
+
+// fetch 类操作：返回修改前的值
+#define __ATOMIC_FETCH_OP(prefix, type, sz, fn, op, sfx, ord)    \
+static inline type                                               \
+prefix##_##fn##sfx(volatile type *p, type v)                     \
+{                                                                \
+  type old;                                                      \
+  asm volatile("amo" #op "." sz ord " %0, %2, %1"                \
+               : "=r" (old), "+A" (*p) : "r" (v) : "memory");    \
+  return old;                                                    \
+}
+
+#define __ATOMIC_FETCH_OPS(prefix, type, sz, fn, op)                 \
+  __ATOMIC_FETCH_OP(prefix, type, sz, fn, op, _relaxed, "")          \
+  __ATOMIC_FETCH_OP(prefix, type, sz, fn, op, _acquire, ".aq")       \
+  __ATOMIC_FETCH_OP(prefix, type, sz, fn, op, _release, ".rl")       \
+  __ATOMIC_FETCH_OP(prefix, type, sz, fn, op, , ".aqrl")
+
+// 比较并交换：*p 等于 old 时写入 new。返回 *p 原来的值，等于 old 即成功
+// lr.w 把读到的值符号扩展，所以 32 位的 old 也要先按 stype 符号扩展再比较
+#define __ATOMIC_CMPXCHG(prefix, type, stype, sz, sfx, lr, sc)       \
+static inline type                                                   \
+prefix##_cmpxchg##sfx(volatile type *p, type old, type new)         \
+{                                                                    \
+  type cur;                                                          \
+  uint64 fail;                                                       \
+  asm volatile("1: lr." sz lr " %0, %2\n"                            \
+               "   bne %0, %3, 2f\n"                                 \
+               "   sc." sz sc " %1, %4, %2\n"                        \
+               "   bnez %1, 1b\n"                                    \
+               "2:"                                                  \
+               : "=&r" (cur), "=&r" (fail), "+A" (*p)                \
+               : "r" ((long)(stype)old), "r" (new)                   \
+               : "memory");                                          \
+  return cur;                                                        \
+}
+
+#define __ATOMIC_CMPXCHGS(prefix, type, stype, sz)                   \
+  __ATOMIC_CMPXCHG(prefix, type, stype, sz, _relaxed, "", "")        \
+  __ATOMIC_CMPXCHG(prefix, type, stype, sz, _acquire, ".aq", "")     \
+  __ATOMIC_CMPXCHG(prefix, type, stype, sz, _release, "", ".rl")     \
+  __ATOMIC_CMPXCHG(prefix, type, stype, sz, , ".aqrl", ".rl")
+
+#define __ATOMIC_OPS(prefix, type, stype, sz)                        \
+  __ATOMIC_FETCH_OPS(prefix, type, sz, fetch_add, add)               \
+  __ATOMIC_FETCH_OPS(prefix, type, sz, fetch_and, and)               \
+  __ATOMIC_FETCH_OPS(prefix, type, sz, fetch_or, or)                 \
+  __ATOMIC_FETCH_OPS(prefix, type, sz, fetch_xor, xor)               \
+  __ATOMIC_FETCH_OPS(prefix, type, sz, xchg, swap)                   \
+  __ATOMIC_CMPXCHGS(prefix, type, stype, sz)                         \
+                                                                     \
+/* 普通的读写，只保证不被编译器拆分或合并 */                          \
+static inline type                                                   \
+prefix##_read(volatile type *p)                                      \
+{                                                                    \
+  return *p;                                                         \
+}                                                                    \
+                                                                     \
+static inline void                                                   \
+prefix##_set(volatile type *p, type v)                               \
+{                                                                    \
+  *p = v;                                                            \
+}                                                                    \
+                                                                     \
+/* 读之后的访存不会提前到读之前 */                                    \
+static inline type                                                   \
+prefix##_load_acquire(volatile type *p)                              \
+{                                                                    \
+  type v = *p;                                                       \
+  asm volatile("fence r, rw" ::: "memory");                          \
+  return v;                                                          \
+}                                                                    \
+                                                                     \
+/* 写之前的访存不会推迟到写之后 */                                    \
+static inline void                                                   \
+prefix##_store_release(volatile type *p, type v)                     \
+{                                                                    \
+  asm volatile("fence rw, w" ::: "memory");                          \
+  *p = v;                                                            \
+}                                                                    \
+                                                                     \
+/* 不需要旧值的计数器更新，结果写到 zero 寄存器 */                    \
+static inline void                                                   \
+prefix##_add(volatile type *p, type v)                               \
+{                                                                    \
+  asm volatile("amoadd." sz " zero, %1, %0"                          \
+               : "+A" (*p) : "r" (v) : "memory");                    \
+}                                                                    \
+                                                                     \
+static inline void                                                   \
+prefix##_inc(volatile type *p)                                       \
+{                                                                    \
+  prefix##_add(p, 1);                                                \
+}                                                                    \
+                                                                     \
+static inline void                                                   \
+prefix##_dec(volatile type *p)                                       \
+{                                                                    \
+  prefix##_add(p, (type)-1);                                         \
+}
+
+__ATOMIC_OPS(atomic, uint, int, "w")
+__ATOMIC_OPS(atomic64, uint64, long, "d")
+
+// 指针的交换与比较交换
+#define atomic_xchg_ptr(pp, v) \
+  ((__typeof__(*(pp)))atomic64_xchg((volatile uint64 *)(pp), (uint64)(v)))
+#define atomic_cmpxchg_ptr(pp, old, new) \
+  ((__typeof__(*(pp)))atomic64_cmpxchg((volatile uint64 *)(pp), (uint64)(old), (uint64)(new)))
+#define atomic_cmpxchg_ptr_release(pp, old, new) \
+  ((__typeof__(*(pp)))atomic64_cmpxchg_release((volatile uint64 *)(pp), (uint64)(old), (uint64)(new)))
+
+#endif // XV6_ATOMIC_H
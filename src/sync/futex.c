@@ -0,0 +1,132 @@
+// Futex：在用户内存中的一个字上等待和唤醒。
+//
+// 用户态的锁在无竞争时只用原子指令修改共享字，不进入内核；
+// 有竞争时才调用 futex_wait() 等待该字变化，由解锁方调用 futex_wake()。
+// 等待者按字的物理地址散列到桶中，因此映射同一物理页的不同地址空间
+// （共享内存、共享代码缓存）可以互相唤醒。
+//
+// 等待期间用 swap_pin() 钉住页面，回收器不会把它换出，
+// 等待者记录的物理地址一直有效。
+//
+// 还没有进程，等待者就是 CPU 本身，通过 waitq 停在 wfi 上。
+// 以后的系统调用传入 myproc()->pagetable 即可。
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "waitq.h"
+
+#define NFUTEXHASH 64
+
+// 一个等待者，放在等待 CPU 的栈上
+struct futex_waiter {
+  uint64 pa;                  // 等待的字的物理地址
+  int woken;                  // 已被 futex_wake() 摘下
+  struct waitq wq;
+  struct futex_waiter *next;
+};
+
+static struct futex_bucket {
+  struct spinlock lock;
+  struct futex_waiter *head;
+} futex_hash[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXHASH; i++)
+    initlock(&futex_hash[i].lock, "futex");
+}
+
+static struct futex_bucket *
+futex_bucket(uint64 pa)
+{
+  return &futex_hash[(pa >> 2) % NFUTEXHASH];
+}
+
+// 用户地址 uaddr 对应的物理地址，页面已换出时先换入。失败返回 0。
+// 只用于 futex_wake()：有等待者的页面被钉住，不会处于换出状态
+static uint64
+futex_pa(pagetable_t pagetable, uint64 uaddr)
+{
+  uint64 pa;
+
+  if(uaddr % sizeof(uint))
+    return 0;
+  if((pa = walkaddr(pagetable, PGROUNDDOWN(uaddr))) == 0){
+    if(swap_fault(pagetable, uaddr, 0) != 0)
+      return 0;
+    if((pa = walkaddr(pagetable, PGROUNDDOWN(uaddr))) == 0)
+      return 0;
+  }
+  return pa + uaddr % PGSIZE;
+}
+
+// 若 uaddr 处的字仍等于 val，则等待直到 futex_wake()。
+// 被唤醒返回 0，字已经不等于 val 返回 1，地址无效返回 -1，
+// 钉住页面的表已满返回 -2（暂时的，调用者可以稍后重试）。
+int
+futex_wait(pagetable_t pagetable, uint64 uaddr, uint val)
+{
+  struct futex_bucket *b;
+  struct futex_waiter w;
+  uint64 pa;
+  int r;
+
+  if(uaddr % sizeof(uint))
+    return -1;
+  if((r = swap_pin(pagetable, uaddr, &pa)) != 0)
+    return r;
+  pa += uaddr % PGSIZE;
+  b = futex_bucket(pa);
+
+  acquire(&b->lock);
+  // 在桶锁下比较：唤醒方先修改字再获取桶锁，不会丢失唤醒
+  if(*(volatile uint *)pa != val){
+    release(&b->lock);
+    swap_unpin(pa);
+    return 1;
+  }
+  w.pa = pa;
+  w.woken = 0;
+  initwaitq(&w.wq, "futex");
+  w.next = b->head;
+  b->head = &w;
+  while(!w.woken)
+    waitq_sleep(&w.wq, &b->lock);
+  release(&b->lock);
+  swap_unpin(pa);
+  return 0;
+}
+
+// 唤醒最多 n 个在 uaddr 上等待的等待者，返回实际唤醒的个数，地址无效返回 -1
+int
+futex_wake(pagetable_t pagetable, uint64 uaddr, int n)
+{
+  struct futex_bucket *b;
+  struct futex_waiter **pp, *w;
+  uint64 pa;
+  int woken = 0;
+
+  if((pa = futex_pa(pagetable, uaddr)) == 0)
+    return -1;
+  b = futex_bucket(pa);
+
+  acquire(&b->lock);
+  for(pp = &b->head; *pp && woken < n; ){
+    w = *pp;
+    if(w->pa != pa){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    waitq_wakeup(&w->wq);
+    woken++;
+  }
+  release(&b->lock);
+  return woken;
+}
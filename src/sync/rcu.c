@@ -0,0 +1,178 @@
+// RCU 的静止状态与宽限期。
+//
+// 每个 CPU 有一个计数器 rcu_ctr，只由该 CPU 写：
+//   - 每经过一次静止状态（不在读临界区中）加 2；
+//   - 进入和离开空闲（main() 中的 wfi）各加 1，因此奇数表示该 CPU 正在空闲，
+//     空闲的 CPU 整段时间都处于静止状态。
+// 尚未启动的 CPU 的计数器初始为 1，同样视为空闲。
+//
+// 宽限期：记下其他所有 CPU 的计数器，等每个 CPU 要么在记录时是奇数，
+// 要么计数器已经变化。此后之前开始的读临界区都已结束。
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "atomic.h"
+#include "rcu.h"
+
+DEFINE_PER_CPU(int, rcu_nesting);
+
+// 每个 CPU 的宽限期状态，只由本 CPU 访问
+struct rcu_data {
+  uint64 ctr;               // 静止状态计数，其他 CPU 只读
+  struct rcu_head *next;    // 新登记、尚未开始等待的回调
+  struct rcu_head *wait;    // 正在等待 snap 对应宽限期的回调
+  uint64 snap[NCPU];        // wait 开始等待时各 CPU 的计数
+};
+
+static DEFINE_PER_CPU(struct rcu_data, rcu_data);
+
+// 由 hart 0 在其他 CPU 启动之前调用，所有 CPU 都先视为空闲
+void
+rcuinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    per_cpu(rcu_data, i).ctr = 1;
+}
+
+// CPU 开始执行内核代码之前调用，此后它的读临界区会被宽限期等待
+static void
+rcu_ctr_add(uint64 n)
+{
+  struct rcu_data *rd = this_cpu_ptr(rcu_data);
+
+  if(this_cpu_read(rcu_nesting) != 0)
+    panic("rcu: quiescent state inside rcu_read_lock");
+  // 本 CPU 之前的读临界区中的访存先于计数变化可见
+  atomic64_store_release(&rd->ctr, rd->ctr + n);
+}
+
+// CPU 开始执行内核代码之前调用，计数变为偶数，
+// 此后它的读临界区会被宽限期等待
+void
+rcu_cpu_online(void)
+{
+  rcu_ctr_add(1);
+}
+
+// 报告一次静止状态：本 CPU 当前不在读临界区中
+void
+rcu_quiescent(void)
+{
+  rcu_ctr_add(2);
+}
+
+// 空闲循环在 wfi 前后调用，调用者已关中断
+void
+rcu_idle_enter(void)
+{
+  rcu_ctr_add(1);
+}
+
+void
+rcu_idle_exit(void)
+{
+  rcu_ctr_add(1);
+  // 离开空闲之后的读不能提前到计数变化之前
+  smp_mb();
+}
+
+static void
+rcu_snapshot(uint64 *snap)
+{
+  // 写者摘除旧版本的写先于读取计数
+  smp_mb();
+  for(int i = 0; i < NCPU; i++)
+    snap[i] = atomic64_read(&per_cpu(rcu_data, i).ctr);
+}
+
+// snap 之后，除 self 外的每个 CPU 是否都经过了静止状态
+static int
+rcu_gp_done(uint64 *snap, int self)
+{
+  for(int i = 0; i < NCPU; i++){
+    if(i == self || (snap[i] & 1))
+      continue;
+    if(atomic64_read(&per_cpu(rcu_data, i).ctr) == snap[i])
+      return 0;
+  }
+  // 之后的释放不能提前到读取计数之前
+  smp_mb();
+  return 1;
+}
+
+// 等待一个宽限期。不能在读临界区中调用。
+void
+synchronize_rcu(void)
+{
+  uint64 snap[NCPU];
+  int self;
+
+  if(this_cpu_read(rcu_nesting) != 0)
+    panic("synchronize_rcu");
+  // 调用者本身不在读临界区中，不需要等自己
+  self = cpuid();
+  rcu_snapshot(snap);
+  while(!rcu_gp_done(snap, self))
+    cpu_relax();
+}
+
+// 一个宽限期之后调用 func(head)。回调在本 CPU 的空闲循环中执行。
+void
+call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *))
+{
+  struct rcu_data *rd;
+
+  head->func = func;
+  push_off();
+  rd = this_cpu_ptr(rcu_data);
+  head->next = rd->next;
+  rd->next = head;
+  pop_off();
+}
+
+static void
+rcu_kfree_cb(struct rcu_head *head)
+{
+  kfree((void *)PGROUNDDOWN((uint64)head));
+}
+
+// 一个宽限期之后释放 head 所在的物理页
+void
+kfree_rcu(struct rcu_head *head)
+{
+  call_rcu(head, rcu_kfree_cb);
+}
+
+// 本 CPU 是否有等待宽限期的回调，有则空闲时不能停掉时钟节拍
+int
+rcu_pending(void)
+{
+  struct rcu_data *rd = this_cpu_ptr(rcu_data);
+
+  return rd->wait != 0 || rd->next != 0;
+}
+
+// 推进本 CPU 的回调，由空闲循环在关中断时调用
+void
+rcu_poll(void)
+{
+  struct rcu_data *rd = this_cpu_ptr(rcu_data);
+  struct rcu_head *h, *next;
+
+  if(rd->wait && rcu_gp_done(rd->snap, cpuid())){
+    for(h = rd->wait; h; h = next){
+      next = h->next;
+      h->func(h);
+    }
+    rd->wait = 0;
+  }
+  if(rd->wait == 0 && rd->next){
+    rd->wait = rd->next;
+    rd->next = 0;
+    rcu_snapshot(rd->snap);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef XV6_RCU_H
+#define XV6_RCU_H
+
+#include "types.h"
+#include "riscv.h"
+#include "percpu.h"
+#include "atomic.h"
+
+// Read-copy-update.
+//
+// 读者用 rcu_read_lock()/rcu_read_unlock() 包住对共享结构的访问，
+// 只修改本 CPU 的嵌套计数，不写任何共享数据，也不等待。
+// 读临界区中不能睡眠，也不能报告静止状态。
+// 写者用 rcu_assign_pointer() 发布新版本或摘除旧版本，
+// 再用 synchronize_rcu() 等待（或用 call_rcu() 登记回调）：
+// 等所有 CPU 都经过一次静止状态后，不会再有读者引用旧版本，可以释放。
+
+struct rcu_head {
+  struct rcu_head *next;
+  void (*func)(struct rcu_head *);
+};
+
+DECLARE_PER_CPU(int, rcu_nesting);
+
+static inline void
+rcu_read_lock(void)
+{
+  this_cpu_inc(rcu_nesting);
+  asm volatile("" ::: "memory");
+}
+
+static inline void
+rcu_read_unlock(void)
+{
+  asm volatile("" ::: "memory");
+  this_cpu_add(rcu_nesting, -1);
+}
+
+// 读者取指针。RISC-V 保证经由地址依赖的读不会乱序，普通的读即可
+#define rcu_dereference(p) \
+  ((__typeof__(p))atomic64_read((volatile uint64 *)&(p)))
+
+// 写者发布指针：之前对新对象的初始化先于指针可见
+#define rcu_assign_pointer(p, v) \
+  atomic64_store_release((volatile uint64 *)&(p), (uint64)(v))
+
+#endif // XV6_RCU_H
@@ -0,0 +1,103 @@
+// Reader-writer spinlocks.
+//
+// 读者在本 CPU 的计数上加一，然后检查 writer；
+// 写者先置 writer，再等所有 CPU 的读者计数归零。
+// 两边都是“先写自己的标志，fence，再读对方的标志”，
+// 所以不会出现读者和写者同时进入临界区。
+// 与 spinlock 一样，持锁期间本 CPU 关中断。
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "atomic.h"
+#include "rwlock.h"
+#include "defs.h"
+#include "proc.h"
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  for(int i = 0; i < NCPU; i++)
+    rw->readers[i].n = 0;
+  rw->writer = 0;
+  rw->name = name;
+  rw->cpu = 0;
+}
+
+void
+read_lock(struct rwlock *rw)
+{
+  volatile uint *n;
+
+  push_off();
+  if(rw->cpu == mycpu())
+    panic("read_lock");
+  n = &rw->readers[cpuid()].n;
+
+  // 本 CPU 已持有读锁：写者一定在等我们，直接嵌套
+  if(*n > 0){
+    (*n)++;
+    return;
+  }
+
+  for(;;){
+    *n = 1;
+    // 先写后读，必须是完整的 fence
+    smp_mb();
+    if(atomic_read(&rw->writer) == 0)
+      break;
+    // 有写者，退出来等它写完，避免写者饿死
+    *n = 0;
+    while(atomic_read(&rw->writer))
+      cpu_relax();
+  }
+}
+
+void
+read_unlock(struct rwlock *rw)
+{
+  volatile uint *n = &rw->readers[cpuid()].n;
+
+  if(*n == 0)
+    panic("read_unlock");
+  // 临界区中的读在计数减一之前完成
+  atomic_store_release(n, *n - 1);
+  pop_off();
+}
+
+void
+write_lock(struct rwlock *rw)
+{
+  push_off();
+  if(rw->cpu == mycpu() || rw->readers[cpuid()].n > 0)
+    panic("write_lock");
+
+  // 写者之间用 writer 互斥
+  while(atomic_xchg_relaxed(&rw->writer, 1) != 0){
+    while(atomic_read(&rw->writer))
+      cpu_relax();
+  }
+  // 先写 writer 后读读者计数，与 read_lock() 对称
+  smp_mb();
+
+  // 等已经进入临界区的读者离开
+  for(int i = 0; i < NCPU; i++){
+    while(atomic_read(&rw->readers[i].n))
+      cpu_relax();
+  }
+  // 读者离开之后才进入临界区
+  smp_mb();
+
+  rw->cpu = mycpu();
+}
+
+void
+write_unlock(struct rwlock *rw)
+{
+  if(rw->cpu != mycpu())
+    panic("write_unlock");
+  rw->cpu = 0;
+  atomic_xchg_release(&rw->writer, 0);
+  pop_off();
+}
@@ -0,0 +1,23 @@
+#ifndef XV6_RWLOCK_H
+#define XV6_RWLOCK_H
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+
+// Reader-writer spinlock for read-mostly data.
+// 每个 CPU 有自己的读者计数，各占一个缓存行：
+// 读者只写本 CPU 的计数，不同 CPU 上的读者之间没有缓存行来回迁移。
+// 写者代价较高，要检查所有 CPU 的计数。
+struct rwlock {
+  struct {
+    uint n;          // 本 CPU 持有读锁的层数
+  } __attribute__((aligned(CACHELINE))) readers[NCPU];
+  uint writer;       // 有写者持有或正在等待
+
+  // For debugging:
+  char *name;        // Name of lock.
+  struct cpu *cpu;   // 持有写锁的 cpu
+};
+
+#endif // XV6_RWLOCK_H
@@ -0,0 +1,70 @@
+#ifndef XV6_SEQLOCK_H
+#define XV6_SEQLOCK_H
+
+#include "types.h"
+#include "spinlock.h"
+#include "atomic.h"
+
+// Sequence lock for small, frequently read data.
+// 写者之间用 spinlock 互斥，写之前和写之后各把 seq 加一，
+// 因此 seq 为奇数表示正在写。读者不写任何共享数据：
+//
+//   do {
+//     s = read_seqbegin(&sl);
+//     ... 复制受保护的数据 ...
+//   } while(read_seqretry(&sl, s));
+//
+// 写者持锁期间中断是关闭的，所以中断处理程序中的读者
+// 不会在同一 CPU 上等待一个永远写不完的写者。
+struct seqlock {
+  uint seq;
+  struct spinlock lock;
+};
+
+static inline void
+initseqlock(struct seqlock *sl, char *name)
+{
+  sl->seq = 0;
+  initlock(&sl->lock, name);
+}
+
+static inline uint
+read_seqbegin(struct seqlock *sl)
+{
+  uint s;
+
+  while((s = atomic_read(&sl->seq)) & 1)
+    cpu_relax();
+  // 读 seq 之后才读数据
+  smp_rmb();
+  return s;
+}
+
+// 读期间有写者修改过数据时返回 1，调用者应重读
+static inline int
+read_seqretry(struct seqlock *sl, uint s)
+{
+  // 数据读完之后才重读 seq
+  smp_rmb();
+  return atomic_read(&sl->seq) != s;
+}
+
+static inline void
+write_seqlock(struct seqlock *sl)
+{
+  acquire(&sl->lock);
+  atomic_set(&sl->seq, sl->seq + 1);
+  // seq 变成奇数之后才写数据
+  smp_wmb();
+}
+
+static inline void
+write_sequnlock(struct seqlock *sl)
+{
+  // 数据写完之后 seq 才变回偶数
+  smp_wmb();
+  atomic_set(&sl->seq, sl->seq + 1);
+  release(&sl->lock);
+}
+
+#endif // XV6_SEQLOCK_H
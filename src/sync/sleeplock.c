@@ -0,0 +1,82 @@
+// Sleeping locks
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "atomic.h"
+#include "sleeplock.h"
+
+// 获取失败后最多自旋这么多次 cpu_relax()，再去等待队列上阻塞
+#define SLEEPLOCK_SPIN 2000
+
+void
+initsleeplock(struct sleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "sleep lock");
+  initwaitq(&lk->wq, name);
+  lk->name = name;
+  lk->locked = 0;
+  lk->owner = -1;
+}
+
+// 持有者正在另一个 CPU 上运行（没有停在 waitq 上），值得再自旋等一等
+static int
+owner_running(struct sleeplock *lk)
+{
+  int owner = lk->owner;
+
+  return owner >= 0 && !atomic_read(&per_cpu(parked, owner));
+}
+
+void
+acquiresleep(struct sleeplock *lk)
+{
+  if(holdingsleep(lk))
+    panic("acquiresleep");
+
+  for(;;){
+    if(atomic_read(&lk->locked) == 0 && atomic_xchg_acquire(&lk->locked, 1) == 0)
+      break;
+
+    // 自适应自旋：持有者在运行时，锁往往很快就会释放
+    for(int i = 0; i < SLEEPLOCK_SPIN && atomic_read(&lk->locked) && owner_running(lk); i++)
+      cpu_relax();
+    if(atomic_read(&lk->locked) == 0)
+      continue;
+
+    // 持有者迟迟不释放或者自己也在等待：阻塞
+    acquire(&lk->lk);
+    if(atomic_read(&lk->locked))
+      waitq_sleep(&lk->wq, &lk->lk);
+    release(&lk->lk);
+  }
+  lk->owner = cpuid();
+}
+
+void
+releasesleep(struct sleeplock *lk)
+{
+  if(!holdingsleep(lk))
+    panic("releasesleep");
+  lk->owner = -1;
+  atomic_xchg_release(&lk->locked, 0);
+
+  // 在 lk->lk 之下唤醒，与 acquiresleep() 中的检查互斥，不会丢失唤醒
+  acquire(&lk->lk);
+  waitq_wakeup(&lk->wq);
+  release(&lk->lk);
+}
+
+int
+holdingsleep(struct sleeplock *lk)
+{
+  int r;
+
+  push_off();
+  r = lk->locked && lk->owner == cpuid();
+  pop_off();
+  return r;
+}
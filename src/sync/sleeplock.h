@@ -0,0 +1,21 @@
+#ifndef XV6_SLEEPLOCK_H
+#define XV6_SLEEPLOCK_H
+
+#include "types.h"
+#include "spinlock.h"
+#include "waitq.h"
+
+// Long-term locks for processes
+// 用于可能持有很久的临界区（磁盘 I/O、大块复制）：
+// 持有者在其他 CPU 上运行时先短暂自旋，之后停在等待队列上，不空转。
+struct sleeplock {
+  uint locked;       // Is the lock held?
+  struct spinlock lk; // spinlock protecting this sleep lock
+  struct waitq wq;   // 等待这把锁的 CPU
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int owner;         // 持有者所在的 CPU，-1 表示空闲；以后可换成持有的进程
+};
+
+#endif // XV6_SLEEPLOCK_H
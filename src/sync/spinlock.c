@@ -2,15 +2,188 @@
 #include "defs.h"
 #include "proc.h"
 #include "riscv.h"
+#include "memlayout.h"
+#include "atomic.h"
+#include "static_key.h"
+#include "trace.h"
+
+// test-and-set 锁抢锁失败后的退避，单位是 cpu_relax() 次数，每次失败翻倍
+#define BACKOFF_MIN 4
+#define BACKOFF_MAX 1024
+
+#ifdef LOCKSTAT
+// 所有初始化过的静态锁，头插法串成链表
+static struct spinlock *locklist;
+
+extern char etext[], end[];        // kernel.ld
+extern char stack0[];              // start.c
+
+// 只登记内核映像中静态存储的锁（全局变量、per-CPU 区域）。
+// 栈上的锁和 kalloc() 得到的内存中的锁会失效，而链表没有删除操作，
+// 它们只在自己的 stat 中计数，不出现在 lockstat_print() 中
+static int
+lockstat_static(struct spinlock *lk)
+{
+  char *p = (char *)lk;
+
+  if(p < etext || p >= end)
+    return 0;
+  // 启动栈也在 .bss 中
+  return p < stack0 || p >= stack0 + 4096 * NCPU;
+}
+
+static void
+lockstat_register(struct spinlock *lk)
+{
+  struct spinlock *head;
+
+  memset(&lk->stat, 0, sizeof(lk->stat));
+  if(!lockstat_static(lk))
+    return;
+  do {
+    head = locklist;
+    lk->stat.nextlk = head;
+  } while(atomic_cmpxchg_ptr(&locklist, head, lk) != head);
+}
+#endif
 
 // 如果涉及到中断上下文的访问，spin lock需要和禁止本CPU上的中断联合使用。
 // 否则时间中断发生在同一 CPU 时，可能会在中断处理程序中再次请求同一把锁，从而导致死锁。
 void
 initlock(struct spinlock *lk, char *name)
+{
+  initlock_kind(lk, name, SPIN_TAS);
+}
+
+// 以指定方式初始化锁。
+// 竞争激烈、需要公平性的锁用 SPIN_TICKET 或 SPIN_MCS：
+// 等待者按到达顺序获得锁，不会有 CPU 一直抢不到。
+// 票据锁的等待者都读同一个 owner 字段，每次交接都要让所有等待者的缓存行失效；
+// MCS 的每个等待者只在自己 CPU 的节点上自旋，交接只触及下一个等待者。
+void
+initlock_kind(struct spinlock *lk, char *name, int kind)
 {
   lk->name = name;
   lk->locked = 0;
+  lk->kind = kind;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lockstat_register(lk);
+#endif
+}
+
+// 从本 CPU 的节点中取一个空闲的。中断已关闭。
+static struct mcs_node *
+mcs_get(struct cpu *c)
+{
+  for(int i = 0; i < NMCS; i++){
+    if(!c->mcs[i].busy){
+      c->mcs[i].busy = 1;
+      return &c->mcs[i];
+    }
+  }
+  panic("mcs_get: too many MCS locks held");
+  return 0;
+}
+
+// 以下三个 *_acquire 在需要等待时返回 1，直接拿到锁返回 0
+
+static int
+ticket_acquire(struct spinlock *lk)
+{
+  uint me;
+
+  // 取号：amoadd.w，每个 CPU 只在这里写一次共享行。
+  // 取号本身不需要排序，叫到号时的 acquire 读才是上锁点
+  me = atomic_fetch_add_relaxed(&lk->next, 1);
+  if(atomic_load_acquire(&lk->owner) == me)
+    return 0;
+  // 等叫号：只读自旋，不再发原子操作
+  while(atomic_read(&lk->owner) != me)
+    cpu_relax();
+  atomic_load_acquire(&lk->owner);
+  return 1;
+}
+
+static void
+ticket_release(struct spinlock *lk)
+{
+  // 只有持有者写 owner，带 release 语义的普通写即可
+  atomic_store_release(&lk->owner, lk->owner + 1);
+}
+
+// test-and-test-and-set：锁被占用时只读 locked，读到的是本地缓存中的副本，
+// 不产生总线流量；看起来空闲时才发 amoswap 去抢。
+// 抢失败说明还有别的 CPU 在抢，等待一段指数增长的时间再试，避免它们同时重试。
+static int
+tas_acquire(struct spinlock *lk)
+{
+  int backoff = BACKOFF_MIN;
+  int waited = 0;
+
+  for(;;waited = 1){
+    while(atomic_read(&lk->locked)){
+      waited = 1;
+      cpu_relax();
+    }
+    // amoswap.w.aq：临界区中的访存不会提前到拿到锁之前，
+    // 不需要额外的 fence
+    if(atomic_xchg_acquire(&lk->locked, 1) == 0)
+      return waited;
+    for(int i = 0; i < backoff; i++)
+      cpu_relax();
+    if(backoff < BACKOFF_MAX)
+      backoff <<= 1;
+  }
+}
+
+static int
+mcs_acquire(struct spinlock *lk)
+{
+  struct mcs_node *node, *pred;
+
+  node = mcs_get(mycpu());
+  node->next = 0;
+  node->wait = 1;
+
+  // 把自己换成队尾（amoswap.d.aqrl），得到原来的队尾。
+  // release 让上面对 node 的初始化先于入队可见，
+  // 锁空闲时 acquire 就是上锁点
+  pred = atomic_xchg_ptr(&lk->tail, node);
+  if(pred != 0){
+    // 排在 pred 之后，在自己的节点上等 pred 释放
+    atomic64_set((volatile uint64 *)&pred->next, (uint64)node);
+    while(atomic_read(&node->wait))
+      cpu_relax();
+    atomic_load_acquire(&node->wait);
+  }
+  lk->node = node;
+  return pred != 0;
+}
+
+static void
+mcs_release(struct spinlock *lk)
+{
+  struct mcs_node *node = lk->node, *succ;
+
+  lk->node = 0;
+  succ = (struct mcs_node *)atomic64_read((volatile uint64 *)&node->next);
+  if(succ == 0){
+    // 没有已知的后继：若自己仍是队尾，把队列置空即可
+    if(atomic_cmpxchg_ptr_release(&lk->tail, node, 0) == node){
+      node->busy = 0;
+      return;
+    }
+    // 有 CPU 刚换上队尾但还没链到 node 上，等它链好
+    while((succ = (struct mcs_node *)atomic64_read((volatile uint64 *)&node->next)) == 0)
+      cpu_relax();
+  }
+  atomic_store_release(&succ->wait, 0);
+  node->busy = 0;
 }
 
 // Acquire the lock.
@@ -18,54 +191,95 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  int waited;
+  uint64 t0 = 0;
+#ifdef LOCKSTAT
+  t0 = r_time();
+#else
+  if(trace_enabled(TRACE_LOCK_WAIT))
+    t0 = r_time();
+#endif
+
   push_off(); // disable interrupts to avoid deadlock.
   // 不是再 acquire 一次，否则会死锁，先 panic
-  if(holding(lk))
+  // 检查由 debug_checks 控制，关闭后这里只剩一条 nop
+  if(static_key_true(&debug_checks) && holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  // 自旋等待锁
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  switch(lk->kind){
+  case SPIN_TICKET:
+    waited = ticket_acquire(lk);
+    lk->locked = 1;
+    break;
+  case SPIN_MCS:
+    waited = mcs_acquire(lk);
+    lk->locked = 1;
+    break;
+  default:
+    waited = tas_acquire(lk);
+    break;
+  }
 
-  // Tell the C compiler and the processor to not move loads or stores
-  // past this point, to ensure that the critical section's memory
-  // references happen strictly after the lock is acquired.
-  // On RISC-V, this emits a fence instruction.
-  __sync_synchronize();
+  // 各种锁的上锁操作都带 acquire 语义，临界区中的访存
+  // 不会提前到拿到锁之前，这里不再需要完整的 fence。
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  // 进入时 lock_wait 还没打开就没有取 t0（!trace 可能在等待期间打开它），
+  // 这次等待不记录，否则等待时间会算成从启动开始
+  if(waited && t0 != 0)
+    trace(TRACE_LOCK_WAIT, lk, r_time() - t0);
+
+#ifdef LOCKSTAT
+  // 统计字段只由持有者修改，不需要额外同步
+  lk->stat.stamp = r_time();
+  lk->stat.acquires++;
+  if(waited){
+    uint64 spin = lk->stat.stamp - t0;
+    lk->stat.contended++;
+    lk->stat.spin_total += spin;
+    if(spin > lk->stat.spin_max)
+      lk->stat.spin_max = spin;
+  }
+#endif
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
-  if(!holding(lk))
+  if(static_key_true(&debug_checks) && !holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  uint64 hold = r_time() - lk->stat.stamp;
+  lk->stat.hold_total += hold;
+  if(hold > lk->stat.hold_max)
+    lk->stat.hold_max = hold;
+#endif
+
   lk->cpu = 0;
 
-  // Tell the C compiler and the CPU to not move loads or stores
-  // past this point, to ensure that all the stores in the critical
-  // section are visible to other CPUs before the lock is released,
-  // and that loads in the critical section occur strictly before
-  // the lock is released.
-  // On RISC-V, this emits a fence instruction.
-  __sync_synchronize();
-
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // 各种锁的解锁操作都带 release 语义：临界区中的读写
+  // 在其他 CPU 看到锁被释放之前完成，不需要完整的 fence。
+  switch(lk->kind){
+  case SPIN_TICKET:
+    // 排队锁的 locked 只供 holding() 使用，交出锁之前清掉
+    lk->locked = 0;
+    ticket_release(lk);
+    break;
+  case SPIN_MCS:
+    lk->locked = 0;
+    mcs_release(lk);
+    break;
+  default:
+    // Release the lock, equivalent to lk->locked = 0.
+    // 用 amoswap.w.rl 而不是 C 赋值，写入是单条原子指令，
+    // 并且自带 release 语义
+    atomic_xchg_release(&lk->locked, 0);
+    break;
+  }
 
   pop_off();
 }
@@ -105,15 +319,60 @@ void
 pop_off(void)
 {
   struct cpu *c = mycpu();
-  // 应该是在关中断情况执行 pop_off
-  if(intr_get())
-    panic("pop_off - interruptible");
-  // 要先 push_off
-  if(c->noff < 1)
-    panic("pop_off");
+  if(static_key_true(&debug_checks)){
+    // 应该是在关中断情况执行 pop_off
+    if(intr_get())
+      panic("pop_off - interruptible");
+    // 要先 push_off
+    if(c->noff < 1)
+      panic("pop_off");
+  }
   c->noff -= 1;
 
   // 如果最初是开中断模式，并且完成所有中断嵌套，就开中断
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+#ifdef LOCKSTAT
+#define NLOCKSTAT 64
+
+// 按竞争次数从多到少打印每把锁的统计，时间单位为微秒
+void
+lockstat_print(void)
+{
+  static struct spinlock *sorted[NLOCKSTAT];
+  struct spinlock *lk, *t;
+  int n = 0, i, j;
+
+  for(lk = locklist; lk && n < NLOCKSTAT; lk = lk->stat.nextlk){
+    // 插入排序
+    for(i = n++; i > 0 && sorted[i-1]->stat.contended < lk->stat.contended; i--)
+      sorted[i] = sorted[i-1];
+    sorted[i] = lk;
+  }
+
+  printf("lockstat: name kind acquires contended spin(us) total/max hold(us) total/max\n");
+  for(j = 0; j < n; j++){
+    t = sorted[j];
+    printf("  %s %s %lu %lu %lu/%lu %lu/%lu\n", t->name,
+           t->kind == SPIN_TICKET ? "ticket" : t->kind == SPIN_MCS ? "mcs" : "tas",
+           t->stat.acquires, t->stat.contended,
+           t->stat.spin_total * 1000000 / TIMEBASE_HZ, t->stat.spin_max * 1000000 / TIMEBASE_HZ,
+           t->stat.hold_total * 1000000 / TIMEBASE_HZ, t->stat.hold_max * 1000000 / TIMEBASE_HZ);
+  }
+}
+
+// 清零所有锁的计数，用于只统计某一段负载
+void
+lockstat_reset(void)
+{
+  struct spinlock *lk;
+
+  for(lk = locklist; lk; lk = lk->stat.nextlk){
+    lk->stat.acquires = lk->stat.contended = 0;
+    lk->stat.spin_total = lk->stat.spin_max = 0;
+    lk->stat.hold_total = lk->stat.hold_max = 0;
+  }
+}
+#endif // LOCKSTAT
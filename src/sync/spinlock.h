@@ -3,13 +3,52 @@
 #define XV6_SPINLOCK_H
 
 #include "types.h"
+
+// 锁的实现方式，由 initlock_kind() 按锁选择
+#define SPIN_TAS    0  // test-and-set，initlock() 的默认方式
+#define SPIN_TICKET 1  // 票据锁：按到达顺序获得锁
+#define SPIN_MCS    2  // MCS 队列锁：每个等待者只在自己的节点上自旋
+
+// MCS 锁的排队节点，每个 CPU 在 struct cpu 中有 NMCS 个
+struct mcs_node {
+  struct mcs_node *next; // 队列中的后继
+  uint wait;             // 为 1 时继续等待，前驱释放锁时清零
+  int busy;              // 节点正被某把锁使用
+};
+
+#ifdef LOCKSTAT
+// 锁竞争统计，时间单位为 mtime 计数（见 TIMEBASE_HZ）
+struct lockstat {
+  uint64 acquires;    // 获取次数
+  uint64 contended;   // 需要等待的获取次数
+  uint64 spin_total;  // 等待锁的总时间
+  uint64 spin_max;    // 单次等待的最长时间
+  uint64 hold_total;  // 持有锁的总时间
+  uint64 hold_max;    // 单次持有的最长时间
+  uint64 stamp;       // 本次获得锁的时刻
+  struct spinlock *nextlk; // 所有锁串成的链表，供 lockstat_print() 遍历
+};
+#endif
+
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+  int kind;          // SPIN_TAS / SPIN_TICKET / SPIN_MCS
+
+  // SPIN_TICKET
+  uint next;         // 下一张要发出的票
+  uint owner;        // 当前持有锁的票
+
+  // SPIN_MCS
+  struct mcs_node *tail; // 等待队列的队尾
+  struct mcs_node *node; // 持有者使用的节点
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#ifdef LOCKSTAT
+  struct lockstat stat;
+#endif
 };
 
 #endif // XV6_SPINLOCK_H
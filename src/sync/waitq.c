@@ -0,0 +1,74 @@
+// Wait queues.
+//
+// waitq_sleep() 与 xv6 的 sleep() 用法相同：调用者持有保护等待条件的锁，
+// 检查条件不满足后调用它；waitq_wakeup() 的调用者也必须持有同一把锁，
+// 因此不会丢失唤醒。
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "proc.h"
+#include "atomic.h"
+#include "waitq.h"
+
+DEFINE_PER_CPU(uint, parked);
+
+void
+initwaitq(struct waitq *wq, char *name)
+{
+  wq->waiters = 0;
+  wq->name = name;
+}
+
+// 释放 lk 并让本 CPU 停下，直到被 waitq_wakeup() 唤醒，返回前重新获取 lk。
+// 等待期间由 softintr() 处理到来的时钟节拍和 IPI。
+// wfi 总是关中断执行：检查 parked 之后才到达的 IPI 保持挂起，wfi 立即返回，
+// 不会在处理完唤醒之后才进入 wfi 而睡过去。
+// 调用者不再持有其他 spinlock 时，每次醒来短暂打开中断，设备中断照常处理；
+// 否则设备中断要等调用者放开锁之后才处理。
+void
+waitq_sleep(struct waitq *wq, struct spinlock *lk)
+{
+  uint *p = this_cpu_ptr(parked);
+  int nested;
+
+  if(!holding(lk))
+    panic("waitq_sleep");
+
+  wq->waiters |= 1L << cpuid();
+  *p = 1;
+  release(lk);
+
+  push_off();
+  nested = mycpu()->noff > 1;
+  while(atomic_load_acquire(p)){
+    softintr();
+    if(!atomic_load_acquire(p))
+      break;
+    asm volatile("wfi");
+    if(!nested){
+      intr_on();
+      intr_off();
+    }
+  }
+  pop_off();
+
+  acquire(lk);
+}
+
+// 唤醒在 wq 上等待的所有 CPU。调用者持有 waitq_sleep() 用的同一把锁
+void
+waitq_wakeup(struct waitq *wq)
+{
+  uint64 w = wq->waiters;
+
+  wq->waiters = 0;
+  for(int i = 0; w; i++, w >>= 1){
+    if((w & 1) == 0)
+      continue;
+    atomic_store_release(&per_cpu(parked, i), 0);
+    ipi_send(i, IPI_WAKE);
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef XV6_WAITQ_H
+#define XV6_WAITQ_H
+
+#include "types.h"
+#include "percpu.h"
+
+// Wait queue of parked harts.
+// 还没有进程和调度器，“阻塞”就是让 CPU 停在 wfi 上，
+// 直到 waitq_wakeup() 通过 IPI 把它叫醒。等待条件由调用者的 spinlock 保护。
+struct waitq {
+  uint64 waiters;    // 在此等待的 CPU 位图，由调用者的锁保护
+  char *name;
+};
+
+// 本 CPU 是否停在某个 waitq 上。sleeplock 据此判断持有者是否还在运行
+DECLARE_PER_CPU(uint, parked);
+
+#endif // XV6_WAITQ_H
@@ -0,0 +1,278 @@
+//
+// 高精度定时器和纳秒时钟，见 hrtimer.h。
+//
+// 每个 CPU 的堆由各自的 spinlock 保护：hrtimer_cancel() 可能在其他 CPU 上调用。
+// timer.c 用 hrtimer_next() 决定本 CPU 下一次时钟中断的时间，
+// 到期后调用 hrtimer_run() 执行回调。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "atomic.h"
+#include "waitq.h"
+#include "hrtimer.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+struct hrtimer_base {
+  struct spinlock lock;
+  int n;
+  struct hrtimer *heap[NHRTIMER];
+  struct spinlock sleep_lock;   // 保护本 CPU 上 hrtimer_sleep_ns() 的 done 标志
+  struct hrtimer *running;      // 正在执行回调的定时器，hrtimer_cancel() 等它结束
+};
+
+static DEFINE_PER_CPU(struct hrtimer_base, hrtimer_base);
+
+// 单调的纳秒时钟，从 mtime 按 TIMEBASE_HZ 换算
+uint64
+ktime_get_ns(void)
+{
+  uint64 t = r_time();
+
+  return t / TIMEBASE_HZ * NSEC_PER_SEC + t % TIMEBASE_HZ * NSEC_PER_SEC / TIMEBASE_HZ;
+}
+
+// 纳秒换算成 mtime 周期，向上取整，定时器不会提前到期
+uint64
+ns_to_mtime(uint64 ns)
+{
+  return ns / NSEC_PER_SEC * TIMEBASE_HZ +
+         (ns % NSEC_PER_SEC * TIMEBASE_HZ + NSEC_PER_SEC - 1) / NSEC_PER_SEC;
+}
+
+void
+hrtimerinithart(void)
+{
+  struct hrtimer_base *b = this_cpu_ptr(hrtimer_base);
+
+  initlock(&b->lock, "hrtimer");
+  initlock(&b->sleep_lock, "hrsleep");
+}
+
+void
+hrtimer_init(struct hrtimer *t, void (*func)(struct hrtimer *))
+{
+  t->expires = 0;
+  t->func = func;
+  t->cpu = -1;
+  t->idx = -1;
+}
+
+static void
+heap_set(struct hrtimer_base *b, int i, struct hrtimer *t)
+{
+  b->heap[i] = t;
+  t->idx = i;
+}
+
+// 把下标 i 处的定时器移到合适的位置
+static void
+heap_fix(struct hrtimer_base *b, int i)
+{
+  struct hrtimer *t = b->heap[i];
+  int c;
+
+  // 上浮
+  while(i > 0 && b->heap[(i - 1) / 2]->expires > t->expires){
+    heap_set(b, i, b->heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  // 下沉
+  while((c = 2 * i + 1) < b->n){
+    if(c + 1 < b->n && b->heap[c + 1]->expires < b->heap[c]->expires)
+      c++;
+    if(b->heap[c]->expires >= t->expires)
+      break;
+    heap_set(b, i, b->heap[c]);
+    i = c;
+  }
+  heap_set(b, i, t);
+}
+
+// 从堆中删除 t。调用者持有 b->lock
+static void
+heap_remove(struct hrtimer_base *b, struct hrtimer *t)
+{
+  int i = t->idx;
+
+  b->n--;
+  if(i != b->n){
+    heap_set(b, i, b->heap[b->n]);
+    heap_fix(b, i);
+  }
+  t->cpu = -1;
+  t->idx = -1;
+}
+
+// 取消 t，返回 1 表示它还在排队。不等待：返回 0 时回调可能正在其他 CPU 上执行
+int
+hrtimer_try_cancel(struct hrtimer *t)
+{
+  struct hrtimer_base *b;
+  int cpu;
+
+  for(;;){
+    if((cpu = t->cpu) < 0)
+      return 0;
+    b = per_cpu_ptr(hrtimer_base, cpu);
+    acquire(&b->lock);
+    // 获取锁期间 t 可能已经到期或换了 CPU
+    if(t->cpu == cpu)
+      break;
+    release(&b->lock);
+  }
+  heap_remove(b, t);
+  release(&b->lock);
+  return 1;
+}
+
+// 是否有 CPU 正在执行 t 的回调
+static int
+hrtimer_running(struct hrtimer *t)
+{
+  for(int i = 0; i < NCPU; i++)
+    if((struct hrtimer *)atomic64_load_acquire((volatile uint64 *)&per_cpu(hrtimer_base, i).running) == t)
+      return 1;
+  return 0;
+}
+
+// 取消 t，并等待正在执行的回调结束，返回后调用者可以释放或重用 t。
+// 返回 1 表示 t 取消时还在排队。
+// 不能在 t 的回调中调用，也不能持有回调会获取的锁
+int
+hrtimer_cancel(struct hrtimer *t)
+{
+  int ret = 0;
+
+  if(this_cpu_read(hrtimer_base).running == t)
+    panic("hrtimer_cancel: from own callback");
+
+  for(;;){
+    if(hrtimer_try_cancel(t))
+      ret = 1;
+    if(!hrtimer_running(t)){
+      // 回调可能在结束之前重新启动了 t，再取消一次
+      if(atomic_read((volatile uint *)&t->cpu) == (uint)-1)
+        break;
+      continue;
+    }
+    cpu_relax();
+  }
+  return ret;
+}
+
+// 让 t 在 mtime 到达 expires 时到期。已经在排队的定时器先被取消。
+// 不等待正在执行的回调，回调可以用它重新启动自己
+void
+hrtimer_start(struct hrtimer *t, uint64 expires)
+{
+  struct hrtimer_base *b;
+  int first;
+
+  hrtimer_try_cancel(t);
+
+  push_off();
+  b = this_cpu_ptr(hrtimer_base);
+  acquire(&b->lock);
+  if(b->n == NHRTIMER)
+    panic("hrtimer_start: full");
+  t->expires = expires;
+  t->cpu = cpuid();
+  heap_set(b, b->n++, t);
+  heap_fix(b, t->idx);
+  first = t->idx == 0;
+  release(&b->lock);
+
+  // 新的定时器最早到期，提前本 CPU 的时钟中断
+  if(first)
+    timer_reprogram();
+  pop_off();
+}
+
+// 在 ns 纳秒之后到期
+void
+hrtimer_start_ns(struct hrtimer *t, uint64 ns)
+{
+  hrtimer_start(t, r_time() + ns_to_mtime(ns));
+}
+
+// 本 CPU 最早的到期时间，没有定时器时返回 (uint64)-1
+uint64
+hrtimer_next(void)
+{
+  struct hrtimer_base *b = this_cpu_ptr(hrtimer_base);
+  uint64 next;
+
+  acquire(&b->lock);
+  next = b->n > 0 ? b->heap[0]->expires : (uint64)-1;
+  release(&b->lock);
+  return next;
+}
+
+// 执行本 CPU 上到期时间不晚于 now 的定时器。关中断时调用
+void
+hrtimer_run(uint64 now)
+{
+  struct hrtimer_base *b = this_cpu_ptr(hrtimer_base);
+  struct hrtimer *t;
+
+  acquire(&b->lock);
+  while(b->n > 0 && (t = b->heap[0])->expires <= now){
+    heap_remove(b, t);
+    // 回调可能重新启动 t，执行时不持有锁
+    b->running = t;
+    release(&b->lock);
+    t->func(t);
+    acquire(&b->lock);
+    atomic64_store_release((volatile uint64 *)&b->running, 0);
+  }
+  release(&b->lock);
+}
+
+// hrtimer_sleep_ns() 的等待状态，放在等待 CPU 的栈上。
+// 锁用等待者所在 CPU 的 sleep_lock，不在栈上初始化 spinlock。
+// 定时器放在同一个 CPU 的堆上，回调也在这个 CPU 上执行，一个 CPU 同时只有一个等待者
+struct hrsleeper {
+  struct hrtimer timer;     // 必须是第一个成员
+  struct spinlock *lock;
+  struct waitq wq;
+  int done;
+};
+
+static void
+hrsleep_wakeup(struct hrtimer *t)
+{
+  struct hrsleeper *s = (struct hrsleeper *)t;
+
+  acquire(s->lock);
+  s->done = 1;
+  waitq_wakeup(&s->wq);
+  release(s->lock);
+}
+
+// 让本 CPU 等待 ns 纳秒，不受节拍间隔限制。等待期间 CPU 停在 wfi 上
+void
+hrtimer_sleep_ns(uint64 ns)
+{
+  struct hrsleeper s;
+
+  initwaitq(&s.wq, "hrsleep");
+  s.done = 0;
+  hrtimer_init(&s.timer, hrsleep_wakeup);
+
+  // 没有进程，等待者不会换 CPU
+  push_off();
+  s.lock = &this_cpu_ptr(hrtimer_base)->sleep_lock;
+  acquire(s.lock);
+  pop_off();
+  hrtimer_start_ns(&s.timer, ns);
+  while(!s.done)
+    waitq_sleep(&s.wq, s.lock);
+  release(s.lock);
+}
@@ -0,0 +1,19 @@
+#ifndef XV6_HRTIMER_H
+#define XV6_HRTIMER_H
+
+#include "types.h"
+
+// High-resolution timers.
+// 到期时间是绝对的 mtime，精度为一个 mtime 周期（10MHz 下 100ns），
+// 不受节拍间隔限制。每个 CPU 一个按到期时间排序的最小堆，
+// hrtimer_start() 把定时器放进调用者所在 CPU 的堆；
+// 回调在该 CPU 的时钟中断中关中断执行，不能睡眠。
+// hrtimer_cancel() 等待正在执行的回调结束；hrtimer_try_cancel() 不等待。
+struct hrtimer {
+  uint64 expires;                    // 到期的 mtime
+  void (*func)(struct hrtimer *);
+  int cpu;                           // 所在的堆，-1 表示没有排队
+  int idx;                           // 在堆中的下标
+};
+
+#endif // XV6_HRTIMER_H
@@ -0,0 +1,103 @@
+//
+// 处理器间中断 (IPI)。
+// S 模式不能直接向其他 hart 发中断：发送方写目标 hart 的 CLINT MSIP，
+// 目标 hart 在机器模式的 timervec 中清除 MSIP 并转成 S 模式软件中断，
+// 最后由 softintr() 取走 ipi_pending 中的原因位。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+#include "atomic.h"
+
+// 每个 CPU 待处理的 IPI_* 原因位
+static DEFINE_PER_CPU(uint, ipi_pending);
+
+// 每个 CPU 处理过的 IPI_SFENCE 次数，sfence_vma_all() 据此等待确认
+static DEFINE_PER_CPU(uint64, sfence_done);
+
+// 已经启动、能够响应 IPI 的 CPU
+static uint64 online;
+
+// 每个 CPU 启动时调用一次
+void
+ipi_online(void)
+{
+  atomic64_fetch_or(&online, 1L << cpuid());
+}
+
+// 向 cpu 发送带 bits 原因的 IPI
+void
+ipi_send(int cpu, uint bits)
+{
+  atomic_fetch_or(&per_cpu(ipi_pending, cpu), bits);
+  // 原因位和之前的内存写先于 MSIP 写入对目标可见
+  asm volatile("fence w, o" ::: "memory");
+  *(volatile uint32 *)CLINT_MSIP(cpu) = 1;
+}
+
+// 向除自己之外所有已启动的 CPU 发送 IPI
+void
+ipi_send_others(uint bits)
+{
+  uint64 m = atomic64_read(&online);
+  int self;
+
+  push_off();
+  self = cpuid();
+  for(int i = 0; m; i++, m >>= 1)
+    if((m & 1) && i != self)
+      ipi_send(i, bits);
+  pop_off();
+}
+
+// 取走本 CPU 所有待处理的 IPI 原因位
+uint
+ipi_take(void)
+{
+  return atomic_xchg_acquire(this_cpu_ptr(ipi_pending), 0);
+}
+
+// softintr() 收到 IPI_SFENCE 时调用：刷新本 CPU 的 TLB 并确认
+void
+ipi_sfence(void)
+{
+  sfence_vma();
+  atomic64_fetch_add_release(this_cpu_ptr(sfence_done), 1);
+}
+
+// 刷新所有已启动 CPU 的 TLB，等它们都确认之后才返回，
+// 此后不会再有 CPU 通过旧的映射访问内存。
+// 等待时关中断，但继续处理发给自己的 IPI，两个 CPU 同时刷新不会互相等死。
+// 调用者不能持有 spinlock：其他 CPU 可能正关着中断等这把锁，收不到 IPI
+void
+sfence_vma_all(void)
+{
+  uint64 m = atomic64_read(&online);
+  uint64 seen[NCPU];
+  int self;
+
+  push_off();
+  self = cpuid();
+  sfence_vma();
+  for(int i = 0; i < NCPU; i++){
+    if((m & (1L << i)) == 0 || i == self)
+      continue;
+    seen[i] = atomic64_read(&per_cpu(sfence_done, i));
+    ipi_send(i, IPI_SFENCE);
+  }
+  for(int i = 0; i < NCPU; i++){
+    if((m & (1L << i)) == 0 || i == self)
+      continue;
+    while(atomic64_load_acquire(&per_cpu(sfence_done, i)) == seen[i]){
+      if(r_sip() & 2)
+        softintr();
+      cpu_relax();
+    }
+  }
+  pop_off();
+}
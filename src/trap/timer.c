@@ -0,0 +1,117 @@
+//
+// 每个 CPU 的时钟中断编程。
+//
+// 时钟是一次性的：每个 CPU 根据自己待处理的定时事件算出下一个截止时间，
+// 写进比较寄存器（有 Sstc 时是 stimecmp，否则是 CLINT 的 mtimecmp，
+// timervec 在到期后把它设成最大值）。
+// 定时事件是忙碌 CPU 的周期节拍和本 CPU 的高精度定时器（hrtimer.c）。
+// CPU 进入空闲循环时停掉节拍，没有定时器的空闲 CPU 不会被时钟唤醒。停掉的节拍不补发，
+// ticks 由 trap.c 的 ticks_update() 按 mtime 补齐。
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "percpu.h"
+
+#define TIMER_NEVER ((uint64)-1)
+
+struct hart_timer {
+  uint64 tick_next;   // 下一次节拍的时间
+  int tick_stopped;   // 空闲时停掉了节拍
+};
+
+static DEFINE_PER_CPU(struct hart_timer, hart_timer);
+
+// 设定本 CPU 的下一次时钟中断
+static void
+timer_set(uint64 deadline)
+{
+  if(cpufeatures & CPUF_SSTC)
+    w_stimecmp(deadline);
+  else
+    *(volatile uint64 *)CLINT_MTIMECMP(cpuid()) = deadline;
+}
+
+// 按本 CPU 最早的定时事件重新设定比较寄存器。调用者关中断
+static void
+timer_program(struct hart_timer *ht)
+{
+  uint64 deadline = hrtimer_next();
+
+  if(!ht->tick_stopped && ht->tick_next < deadline)
+    deadline = ht->tick_next;
+  timer_set(deadline);
+}
+
+// 本 CPU 的定时事件变化之后重新设定时钟中断。调用者关中断
+void
+timer_reprogram(void)
+{
+  timer_program(this_cpu_ptr(hart_timer));
+}
+
+// 每个 CPU 在开中断之前调用，接管 start.c 设定的第一次时钟中断
+void
+timerinithart(void)
+{
+  struct hart_timer *ht = this_cpu_ptr(hart_timer);
+
+  hrtimerinithart();
+  push_off();
+  ht->tick_next = r_time() + TICK_INTERVAL;
+  ht->tick_stopped = 0;
+  timer_program(ht);
+  pop_off();
+}
+
+// 时钟中断到期时由 trap.c 调用，关中断。
+// 处理到期的事件并设定下一次中断，返回 1 表示经过了一个节拍
+int
+timer_expire(void)
+{
+  struct hart_timer *ht = this_cpu_ptr(hart_timer);
+  uint64 now = r_time();
+  int tick = 0;
+
+  hrtimer_run(now);
+
+  if(!ht->tick_stopped && now >= ht->tick_next){
+    // 落后多个间隔时只算一个节拍，不连续补发
+    ht->tick_next += TICK_INTERVAL;
+    if(ht->tick_next <= now)
+      ht->tick_next = now + TICK_INTERVAL;
+    tick = 1;
+  }
+  timer_program(ht);
+  return tick;
+}
+
+// 空闲循环在 wfi 之前调用（关中断）：没有需要节拍推进的工作时停掉节拍。
+// RCU 回调要靠本 CPU 醒来推进，有回调时保留节拍
+void
+tick_stop(void)
+{
+  struct hart_timer *ht = this_cpu_ptr(hart_timer);
+
+  if(rcu_pending())
+    return;
+  ht->tick_stopped = 1;
+  timer_program(ht);
+}
+
+// 空闲循环在 wfi 返回之后调用（关中断），恢复周期节拍
+void
+tick_restart(void)
+{
+  struct hart_timer *ht = this_cpu_ptr(hart_timer);
+
+  if(!ht->tick_stopped)
+    return;
+  ht->tick_stopped = 0;
+  ht->tick_next = r_time() + TICK_INTERVAL;
+  timer_program(ht);
+}
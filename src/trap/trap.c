@@ -2,11 +2,24 @@
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
-// #include "spinlock.h"
+#include "spinlock.h"
 #include "defs.h"
-
-// struct spinlock tickslock;
+#include "seqlock.h"
+#include "percpu.h"
+#include "atomic.h"
+#include "trace.h"
+#include "proc.h"
+
+DECLARE_PER_CPU(uint64, timer_scratch[6]); // start.c
+#define TIMER_SCRATCH_TICK 5 // timervec 置位的时钟节拍标志
+
+// ticks 是启动以来经过的 TICK_INTERVAL 个数，其他地方通过 readticks() 读取。
+// 空闲的 CPU 会停掉节拍（见 timer.c），所以 ticks 不是逐个节拍累加的，
+// 而是由收到时钟中断的 CPU 按 mtime 补齐；readticks() 只读，
+// 自己算上 tick_last 之后经过的节拍，不写共享状态
+struct seqlock tickslock;
 uint ticks;
+static uint64 tick_last; // ticks 对应的 mtime
 
 // extern char trampoline[], uservec[], userret[];
 
@@ -15,11 +28,44 @@ void kernelvec();
 
 extern int devintr();
 
-// void
-// trapinit(void)
-// {
-//   initlock(&tickslock, "time");
-// }
+void
+trapinit(void)
+{
+  initseqlock(&tickslock, "time");
+  tick_last = r_time();
+}
+
+// 把 ticks 补到当前时间
+static void
+ticks_update(void)
+{
+  uint64 n;
+
+  // 不到一个间隔时不获取写锁，读到旧的 tick_last 只会多进一次锁
+  if(r_time() < tick_last + TICK_INTERVAL)
+    return;
+
+  write_seqlock(&tickslock);
+  n = (r_time() - tick_last) / TICK_INTERVAL;
+  ticks += n;
+  tick_last += n * TICK_INTERVAL;
+  write_sequnlock(&tickslock);
+}
+
+// 读取时钟中断计数。
+// 在读侧临界区里取一致的 ticks 和 tick_last，再补上之后经过的节拍，
+// 读者之间不会争抢写锁。
+uint
+readticks(void)
+{
+  uint s, t;
+
+  do {
+    s = read_seqbegin(&tickslock);
+    t = ticks + (r_time() - tick_last) / TICK_INTERVAL;
+  } while(read_seqretry(&tickslock, s));
+  return t;
+}
 
 // // set up to take exceptions and traps while in the kernel.
 void
@@ -128,6 +174,52 @@ trapinithart(void)
 //   ((void (*)(uint64))trampoline_userret)(satp);
 // }
 
+// 指令 / 读 / 写缺页
+static inline int
+is_page_fault(uint64 scause)
+{
+  return scause == 12 || scause == 13 || scause == 15;
+}
+
+static int plicintr(void);
+static int timerintr(void);
+
+// kernelvec 只保存了调用者保存的寄存器就先调用这里。
+// 不需要完整寄存器帧的中断就地处理完，返回 1，kernelvec 直接返回：
+// 没有进程需要让出 CPU 时的时钟节拍和 IPI、设备中断和空的 PLIC claim。
+// 其余情况（异常、需要 yield、打开了 trap tracepoint）返回 0 且不做任何处理，
+// kernelvec 补存其余寄存器后调用 kerneltrap()。
+// 这里的处理都不会开中断或再次陷入，sepc 和 sstatus 保持不变。
+int
+kerneltrap_fast(void)
+{
+  uint64 scause = r_scause();
+
+  if((scause & 0x8000000000000000L) == 0)
+    return 0;
+  if(trace_enabled(TRACE_TRAP_ENTER) || trace_enabled(TRACE_TRAP_EXIT))
+    return 0;
+
+  switch(scause & 0xff){
+  case 9:
+    // 设备中断的处理程序不让出 CPU
+    plicintr();
+    return 1;
+  case 1:
+  case 5:
+    // 时钟节拍之后可能要 yield()，有进程在运行时走完整的路径
+    if(mycpu()->proc != 0)
+      return 0;
+    if((scause & 0xff) == 1)
+      softintr();
+    else
+      timerintr();
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 // interrupts and exceptions from kernel code go here via kernelvec,
 // on whatever the current kernel stack is.
 void 
@@ -143,7 +235,14 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if((which_dev = devintr()) == 0){
+  trace(TRACE_TRAP_ENTER, scause, sepc);
+
+  // 缺页发生在 satp 指向的地址空间；swap_fault() 只处理登记给回收器的地址空间，
+  // 内核页表没有登记，内核自身的缺页仍然 panic
+  if(is_page_fault(scause) &&
+     swap_fault(SATP2PGTBL(r_satp()), r_stval(), scause == 15) == 0){
+    // 页面已换入（或补上了 A/D 位），返回后重新执行触发缺页的指令
+  } else if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
@@ -154,6 +253,8 @@ kerneltrap()
   // if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
   //   yield();
 
+  trace(TRACE_TRAP_EXIT, scause, 0);
+
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
@@ -163,10 +264,75 @@ kerneltrap()
 void
 clockintr()
 {
-//   acquire(&tickslock);
-  ticks++;
+  ticks_update();
 //   wakeup(&ticks);
-//   release(&tickslock);
+}
+
+// 处理一个 PLIC 转来的设备中断
+static int
+plicintr(void)
+{
+  // irq indicates which device interrupted.
+  int irq = plic_claim();
+
+  if(irq == UART0_IRQ){
+    uartintr();
+  } else if(irq == VIRTIO0_IRQ){
+    virtio_disk_intr();
+  } else if(irq){
+  //   printf("unexpected interrupt irq=%d\n", irq);
+  }
+
+  // the PLIC allows each device to raise at most one
+  // interrupt at a time; tell the PLIC the device is
+  // now allowed to interrupt again.
+  if(irq)
+    plic_complete(irq);
+
+  return irq;
+}
+
+// 本 CPU 设定的时钟到期：timervec 转来的软件中断，或者 Sstc 的 S 模式时钟中断。
+// 返回 1 表示其中有时钟节拍
+static int
+timerintr(void)
+{
+  if(!timer_expire())
+    return 0;
+  // 任何一个忙碌的 CPU 都可以推进 ticks，hart 0 可能正在空闲
+  clockintr();
+  return 1;
+}
+
+// 处理 S 模式软件中断：时钟节拍和 IPI。
+// 除了 devintr()，在 waitq 中关中断等待的 CPU 也直接调用它。
+// 返回 1 表示其中有时钟节拍。
+int
+softintr(void)
+{
+  int tick = 0;
+  uint ipi;
+
+  // acknowledge the software interrupt by clearing
+  // the SSIP bit in sip. 先清 SSIP 再取原因，之后到达的中断会再次置位 SSIP
+  w_sip(r_sip() & ~2);
+
+  if(atomic64_xchg_acquire(&this_cpu_read(timer_scratch)[TIMER_SCRATCH_TICK], 0))
+    tick = timerintr();
+
+  // Sstc 的时钟中断不经过 SSIP：关中断等待的 CPU 也要在这里处理，
+  // 否则 STIP 一直置位，wfi 立即返回
+  if(r_sip() & SIP_STIP)
+    tick |= timerintr();
+
+  // IPI_WAKE 只需要把 CPU 从 wfi 中唤醒，等待的条件由 waitq 检查
+  ipi = ipi_take();
+  if(ipi & IPI_FENCE_I)
+    fence_i();
+  if(ipi & IPI_SFENCE)
+    ipi_sfence();
+
+  return tick;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -182,39 +348,16 @@ devintr()
   if((scause & 0x8000000000000000L) &&
      (scause & 0xff) == 9){
     // this is a supervisor external interrupt, via PLIC.
-
-    // irq indicates which device interrupted.
-    int irq = plic_claim();
-
-    if(irq == UART0_IRQ){
-    //   uartintr();
-    } else if(irq == VIRTIO0_IRQ){
-    //   virtio_disk_intr();
-    } else if(irq){
-    //   printf("unexpected interrupt irq=%d\n", irq);
-    }
-
-    // the PLIC allows each device to raise at most one
-    // interrupt at a time; tell the PLIC the device is
-    // now allowed to interrupt again.
-    if(irq)
-      plic_complete(irq);
-
+    plicintr();
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
-    // 通过机器级的时钟中断(timervec)触发的 S 级的软件中断(sip[1] = 0)
-
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
-
-    return 2;
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
+    // 通过机器级的时钟中断或 IPI (timervec) 触发的 S 级的软件中断(sip[1] = 0)
+    return softintr() ? 2 : 1;
+  } else if(scause == 0x8000000000000005L){
+    // supervisor timer interrupt, 只有支持 Sstc 时才会出现
+    return timerintr() ? 2 : 1;
   } else {
     return 0;
   }
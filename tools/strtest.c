@@ -0,0 +1,270 @@
+//
+// src/lib/string.c 中按字处理的 memset/memmove/memcmp/strlen/strncmp
+// 的正确性测试，在宿主机上编译运行，与逐字节的参考实现对比：
+//
+//   make strtest
+//
+// 覆盖所有头部和尾部的对齐组合、展开循环的边界（64 字节）、
+// memmove 两个方向的重叠、长度 0，以及 0x80 以上的字节（检查有符号比较）。
+// 每个缓冲区前后留有哨兵字节，越界写入也会被发现。
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// 内核实现改名，避免和 libc 冲突
+#define memset    k_memset
+#define memcmp    k_memcmp
+#define memmove   k_memmove
+#define memcpy    k_memcpy
+#define strncmp   k_strncmp
+#define strncpy   k_strncpy
+#define safestrcpy k_safestrcpy
+#define strlen    k_strlen
+#include "lib/string.c"
+#undef memset
+#undef memcmp
+#undef memmove
+#undef memcpy
+#undef strncmp
+#undef strncpy
+#undef safestrcpy
+#undef strlen
+
+#define MAXOFF  16      // 测试的起始偏移 0..15，覆盖字内所有位置
+#define MAXLEN  200     // 超过三个展开块
+#define GUARD   32
+#define BUFSZ   (GUARD + MAXOFF + MAXLEN + MAXOFF + GUARD)
+
+static uchar buf1[BUFSZ] __attribute__((aligned(64)));
+static uchar buf2[BUFSZ] __attribute__((aligned(64)));
+static uchar want[BUFSZ] __attribute__((aligned(64)));
+
+static int failures;
+
+#define CHECK(cond, ...)                                     \
+  do {                                                       \
+    if(!(cond)){                                             \
+      printf("FAIL %s:%d: ", __func__, __LINE__);            \
+      printf(__VA_ARGS__);                                   \
+      printf("\n");                                          \
+      if(++failures > 20)                                    \
+        exit(1);                                             \
+    }                                                        \
+  } while(0)
+
+static int
+sign(int x)
+{
+  return (x > 0) - (x < 0);
+}
+
+// 可重复的伪随机填充，字节值覆盖 0x00..0xff
+static void
+fill(uchar *p, int n, uint seed)
+{
+  for(int i = 0; i < n; i++){
+    seed = seed * 1103515245 + 12345;
+    p[i] = seed >> 16;
+  }
+}
+
+static int
+same(const uchar *a, const uchar *b, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(a[i] != b[i])
+      return 0;
+  return 1;
+}
+
+static void
+test_memset(void)
+{
+  static int vals[] = { 0, 0x5a, 0xff, 0x180 };  // 0x180 只取低 8 位
+
+  for(int v = 0; v < sizeof(vals) / sizeof(vals[0]); v++)
+    for(int off = 0; off < MAXOFF; off++)
+      for(int n = 0; n <= MAXLEN; n++){
+        fill(buf1, BUFSZ, n);
+        for(int i = 0; i < BUFSZ; i++)
+          want[i] = buf1[i];
+        for(int i = 0; i < n; i++)
+          want[GUARD + off + i] = (uchar)vals[v];
+
+        void *r = k_memset(buf1 + GUARD + off, vals[v], n);
+        CHECK(r == buf1 + GUARD + off, "return value off=%d n=%d", off, n);
+        CHECK(same(buf1, want, BUFSZ), "c=%#x off=%d n=%d", vals[v], off, n);
+      }
+}
+
+// 不重叠的复制：源和目的各自取所有对齐偏移
+static void
+test_memmove_disjoint(void)
+{
+  for(int soff = 0; soff < MAXOFF; soff++)
+    for(int doff = 0; doff < MAXOFF; doff++)
+      for(int n = 0; n <= MAXLEN; n++){
+        fill(buf1, BUFSZ, 1);
+        fill(buf2, BUFSZ, 2);
+        for(int i = 0; i < BUFSZ; i++)
+          want[i] = buf2[i];
+        for(int i = 0; i < n; i++)
+          want[GUARD + doff + i] = buf1[GUARD + soff + i];
+
+        void *r = k_memmove(buf2 + GUARD + doff, buf1 + GUARD + soff, n);
+        CHECK(r == buf2 + GUARD + doff, "return value");
+        CHECK(same(buf2, want, BUFSZ), "soff=%d doff=%d n=%d", soff, doff, n);
+      }
+}
+
+// 同一缓冲区内重叠的复制，s < d 走向后复制，s > d 走向前复制
+static void
+test_memmove_overlap(void)
+{
+  static uchar tmp[BUFSZ];
+
+  for(int s = 0; s < 2 * MAXOFF; s++)
+    for(int d = 0; d < 2 * MAXOFF; d++)
+      for(int n = 0; n <= MAXLEN; n++){
+        fill(buf1, BUFSZ, n + 3);
+        for(int i = 0; i < BUFSZ; i++)
+          want[i] = buf1[i];
+        for(int i = 0; i < n; i++)
+          tmp[i] = buf1[GUARD + s + i];
+        for(int i = 0; i < n; i++)
+          want[GUARD + d + i] = tmp[i];
+
+        k_memmove(buf1 + GUARD + d, buf1 + GUARD + s, n);
+        CHECK(same(buf1, want, BUFSZ), "s=%d d=%d n=%d", s, d, n);
+      }
+}
+
+static void
+test_memcpy(void)
+{
+  fill(buf1, BUFSZ, 4);
+  fill(buf2, BUFSZ, 5);
+  k_memcpy(buf2 + 3, buf1 + 11, 100);
+  CHECK(same(buf2 + 3, buf1 + 11, 100), "memcpy");
+}
+
+static int
+ref_memcmp(const uchar *a, const uchar *b, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(a[i] != b[i])
+      return a[i] - b[i];
+  return 0;
+}
+
+// 在每个位置放一个差异字节（包括没有差异），两个方向的大小关系都要对
+static void
+test_memcmp(void)
+{
+  for(int off1 = 0; off1 < MAXOFF; off1++)
+    for(int off2 = 0; off2 < MAXOFF; off2++)
+      for(int n = 0; n <= 80; n++)
+        for(int k = -1; k < n; k++){
+          uchar *a = buf1 + GUARD + off1, *b = buf2 + GUARD + off2;
+          fill(a, n, n);
+          fill(b, n, n);
+          if(k >= 0){
+            // 0x01 和 0xff：按有符号 char 比较会得到相反的结果
+            a[k] = 0x01;
+            b[k] = 0xff;
+          }
+          int r1 = k_memcmp(a, b, n), r2 = k_memcmp(b, a, n);
+          CHECK(sign(r1) == sign(ref_memcmp(a, b, n)), "off1=%d off2=%d n=%d k=%d", off1, off2, n, k);
+          CHECK(sign(r2) == -sign(r1), "antisymmetric off1=%d off2=%d n=%d k=%d", off1, off2, n, k);
+        }
+}
+
+// 非 0 字节取 0x01 和 0x80 以上的值：它们最容易让“字中有 0 字节”的判断出错
+static void
+fill_nonzero(uchar *p, int n, uint seed)
+{
+  fill(p, n, seed);
+  for(int i = 0; i < n; i++){
+    if(i % 3 == 0)
+      p[i] = 0x80 | p[i];
+    else if(i % 5 == 0)
+      p[i] = 0x01;
+    if(p[i] == 0)
+      p[i] = 0x7f;
+  }
+}
+
+static void
+test_strlen(void)
+{
+  for(int off = 0; off < MAXOFF; off++)
+    for(int n = 0; n < MAXLEN; n++){
+      uchar *s = buf1 + GUARD + off;
+      fill_nonzero(buf1, BUFSZ, n);
+      s[n] = 0;
+      CHECK(k_strlen((char *)s) == n, "off=%d n=%d got %d", off, n, k_strlen((char *)s));
+    }
+}
+
+static int
+ref_strncmp(const uchar *p, const uchar *q, uint n)
+{
+  for(; n > 0; n--, p++, q++){
+    if(*p != *q)
+      return *p - *q;
+    if(*p == 0)
+      return 0;
+  }
+  return 0;
+}
+
+// len 为字符串长度，k 为差异位置（-1 表示没有差异），limit 为 strncmp 的 n
+static void
+test_strncmp(void)
+{
+  static uint limits[] = { 0, 1, 7, 8, 9, 63, 64, 65, 1000 };
+
+  for(int off1 = 0; off1 < MAXOFF; off1++)
+    for(int off2 = 0; off2 < MAXOFF; off2++)
+      for(int len = 0; len <= 40; len++)
+        for(int k = -1; k <= len; k++)
+          for(int l = 0; l < sizeof(limits) / sizeof(limits[0]); l++){
+            uchar *p = buf1 + GUARD + off1, *q = buf2 + GUARD + off2;
+            fill_nonzero(p, len, len);
+            fill_nonzero(q, len, len);
+            p[len] = q[len] = 0;
+            p[len + 1] = 'x';   // 结尾之后的字节不应影响结果
+            q[len + 1] = 'y';
+            if(k >= 0){
+              // k == len 时一个字符串比另一个长
+              p[k] = 0x01;
+              q[k] = 0xff;
+            }
+            uint n = limits[l];
+            int r = k_strncmp((char *)p, (char *)q, n);
+            CHECK(sign(r) == sign(ref_strncmp(p, q, n)),
+                  "off1=%d off2=%d len=%d k=%d n=%u", off1, off2, len, k, n);
+            CHECK(sign(k_strncmp((char *)q, (char *)p, n)) == -sign(r),
+                  "antisymmetric off1=%d off2=%d len=%d k=%d n=%u", off1, off2, len, k, n);
+          }
+}
+
+int
+main(void)
+{
+  test_memset();
+  test_memmove_disjoint();
+  test_memmove_overlap();
+  test_memcpy();
+  test_memcmp();
+  test_strlen();
+  test_strncmp();
+
+  if(failures){
+    printf("strtest: %d failures\n", failures);
+    return 1;
+  }
+  printf("strtest: ok\n");
+  return 0;
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# 把内核 tracepoint 的导出转换成 Chrome / Perfetto 的 JSON 格式。
+#
+#   python3 tools/trace2json.py console.log > trace.json
+#       解析控制台输出中 trace_dump() 打印的 "trace: begin" ... "trace: end"
+#
+#   python3 tools/trace2json.py --raw trace.bin --stride N [--ncpu 8] [--nevent 256]
+#       解析 QEMU monitor 中
+#         pmemsave <buffers at 地址> <stride * ncpu> trace.bin
+#       保存的内存，地址、stride 和 nevent 见内核打印的 "trace: buffers at ..."
+#
+# 生成的文件可以在 chrome://tracing 或 https://ui.perfetto.dev 中打开。
+# 事件布局与 src/lib/trace.h 和 trace.c 中的 struct trace_event / trace_buf 一致。
+
+import argparse
+import json
+import struct
+import sys
+
+HZ = 10000000  # TIMEBASE_HZ, 控制台导出中的 hz= 会覆盖它
+NAMES = ["trap_enter", "trap_exit", "kalloc", "kfree", "lock_wait"]
+
+EVENT = struct.Struct("<QIIQQ")  # stamp, id, resv, a0, a1
+CACHELINE = 64
+
+SCAUSE = {
+    0x8000000000000001: "software",
+    0x8000000000000005: "timer",
+    0x8000000000000009: "external",
+    12: "instruction page fault",
+    13: "load page fault",
+    15: "store page fault",
+}
+
+
+def parse_console(f):
+    global HZ
+    names = list(NAMES)
+    events = []
+    inside = False
+    for line in f:
+        line = line.strip()
+        if line.startswith("trace: begin"):
+            inside = True
+            events = []
+            for field in line.split()[2:]:
+                k, _, v = field.partition("=")
+                if k == "hz":
+                    HZ = int(v)
+        elif not inside:
+            continue
+        elif line.startswith("trace: event"):
+            _, _, i, name = line.split()
+            i = int(i)
+            while len(names) <= i:
+                names.append("event%d" % len(names))
+            names[i] = name
+        elif line.startswith("trace: end"):
+            inside = False
+        elif line.startswith("T "):
+            _, cpu, stamp, ev, a0, a1 = line.split()
+            events.append((int(cpu), int(stamp, 16), int(ev, 16),
+                           int(a0, 16), int(a1, 16)))
+    return names, events
+
+
+def parse_raw(f, stride, ncpu, nevent):
+    data = f.read()
+    events = []
+    for cpu in range(ncpu):
+        base = cpu * stride
+        if base + CACHELINE > len(data):
+            break
+        (head,) = struct.unpack_from("<Q", data, base)
+        n = min(head, nevent)
+        for i in range(head - n, head):
+            off = base + CACHELINE + (i % nevent) * EVENT.size
+            stamp, ev, _, a0, a1 = EVENT.unpack_from(data, off)
+            events.append((cpu, stamp, ev, a0, a1))
+    return list(NAMES), events
+
+
+def us(stamp):
+    return stamp * 1000000.0 / HZ
+
+
+def convert(names, events):
+    out = []
+    for cpu, stamp, ev, a0, a1 in sorted(events, key=lambda e: (e[1], e[0])):
+        name = names[ev] if ev < len(names) else "event%d" % ev
+        rec = {"pid": 0, "tid": cpu, "ts": us(stamp), "name": name}
+        if name == "trap_enter":
+            rec.update(ph="B", name="trap",
+                       args={"scause": SCAUSE.get(a0, hex(a0)), "sepc": hex(a1)})
+        elif name == "trap_exit":
+            rec.update(ph="E", name="trap")
+        elif name == "lock_wait":
+            rec.update(ph="X", ts=us(stamp - a1), dur=us(a1),
+                       args={"lock": hex(a0)})
+        else:
+            rec.update(ph="i", s="t", args={"a0": hex(a0), "a1": hex(a1)})
+        out.append(rec)
+    for cpu in sorted({e[0] for e in events}):
+        out.append({"ph": "M", "pid": 0, "tid": cpu, "name": "thread_name",
+                    "args": {"name": "hart %d" % cpu}})
+    return {"traceEvents": out, "displayTimeUnit": "ns"}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("file", help="控制台日志，或 --raw 时 pmemsave 保存的内存")
+    ap.add_argument("--raw", action="store_true")
+    ap.add_argument("--stride", type=lambda s: int(s, 0))
+    ap.add_argument("--ncpu", type=int, default=8)
+    ap.add_argument("--nevent", type=int, default=256)
+    args = ap.parse_args()
+
+    if args.raw:
+        if args.stride is None:
+            ap.error("--raw needs --stride")
+        with open(args.file, "rb") as f:
+            names, events = parse_raw(f, args.stride, args.ncpu, args.nevent)
+    else:
+        with open(args.file, errors="replace") as f:
+            names, events = parse_console(f)
+
+    json.dump(convert(names, events), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()